@@ -0,0 +1,111 @@
+#include "../Common/Arguments.hpp"
+#include "../Core/BatchPhysics.hpp"
+
+namespace aita::bench
+{
+	constexpr uint64_t DefaultPlayers = 4096;
+	constexpr uint64_t DefaultFrames = 1000;
+	constexpr uint32_t Seed = 0xA17A;
+
+	std::vector<Body> randomBodies(const Configuration& config, const Physics& physics, size_t count)
+	{
+		std::mt19937 engine(Seed);
+		std::uniform_real_distribution<float> positionX(physics.MinimumX, physics.MaximumX);
+		std::uniform_real_distribution<float> positionY(physics.MinimumY, physics.MaximumY);
+		std::uniform_real_distribution<float> velocityX(-config.Friction * config.MoveVelocity, config.Friction * config.MoveVelocity);
+		std::uniform_real_distribution<float> velocityY(config.JumpVelocity, -config.JumpVelocity);
+
+		std::vector<Body> bodies(count);
+
+		for (Body& body : bodies)
+		{
+			body.position = { positionX(engine), positionY(engine) };
+			body.velocity = { velocityX(engine), velocityY(engine) };
+		}
+
+		return bodies;
+	}
+
+	template <typename F>
+	double measure(F&& function)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		function();
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	bool identical(const Body& a, const Body& b)
+	{
+		return std::bit_cast<uint32_t>(a.position.x) == std::bit_cast<uint32_t>(b.position.x) &&
+			std::bit_cast<uint32_t>(a.position.y) == std::bit_cast<uint32_t>(b.position.y) &&
+			std::bit_cast<uint32_t>(a.velocity.x) == std::bit_cast<uint32_t>(b.velocity.x) &&
+			std::bit_cast<uint32_t>(a.velocity.y) == std::bit_cast<uint32_t>(b.velocity.y) &&
+			a.collision == b.collision;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace aita;
+
+	Arguments arguments(argc, argv);
+
+	if (arguments.contains("--help") || arguments.contains("-h"))
+	{
+		std::println("aitaBench - scalar versus batched player physics");
+		std::println("\noptions:");
+		std::println("\t--players=<value>\tNumber of players (default: {})", bench::DefaultPlayers);
+		std::println("\t--frames=<value>\tNumber of frames to step (default: {})", bench::DefaultFrames);
+		return 0;
+	}
+
+	const uint64_t players = arguments.get<uint64_t>("--players", bench::DefaultPlayers);
+	const uint64_t frames = arguments.get<uint64_t>("--frames", bench::DefaultFrames);
+
+	const Configuration config(Configuration::DefaultWindowWidth, Configuration::DefaultWindowHeight);
+	const Physics physics(config);
+
+	std::vector<Body> bodies = bench::randomBodies(config, physics, players);
+	BatchPhysics batch(config, players);
+
+	for (size_t i = 0; i < players; ++i)
+	{
+		batch.setBody(i, bodies[i]);
+	}
+
+	const double scalarSeconds = bench::measure([&]
+	{
+		for (uint64_t frame = 0; frame < frames; ++frame)
+		{
+			for (Body& body : bodies)
+			{
+				body = physics.step(body);
+			}
+		}
+	});
+
+	const double batchSeconds = bench::measure([&]
+	{
+		for (uint64_t frame = 0; frame < frames; ++frame)
+		{
+			batch.step();
+		}
+	});
+
+	size_t mismatches = 0;
+
+	for (size_t i = 0; i < players; ++i)
+	{
+		mismatches += !bench::identical(bodies[i], batch.body(i));
+	}
+
+	const double steps = static_cast<double>(players * frames);
+
+	std::println("Players: {} | Frames: {}", players, frames);
+	std::println("Scalar:  {:.2f} M player-steps/s", steps / scalarSeconds / 1e6);
+	std::println("Batched: {:.2f} M player-steps/s ({:.2f}x)", steps / batchSeconds / 1e6, scalarSeconds / batchSeconds);
+	std::println("Mismatching players: {}", mismatches);
+
+	return mismatches == 0 ? 0 : 1;
+}
\ No newline at end of file
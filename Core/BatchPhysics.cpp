@@ -0,0 +1,209 @@
+#include "BatchPhysics.hpp"
+
+namespace aita
+{
+#if defined(__AVX2__)
+#define AITA_BATCH_SIMD
+	struct Lanes
+	{
+		using Vector = __m256;
+		constexpr static size_t Width = 8;
+
+		static Vector load(const float* source) { return _mm256_loadu_ps(source); }
+		static void store(float* destination, Vector value) { _mm256_storeu_ps(destination, value); }
+		static Vector broadcast(float value) { return _mm256_set1_ps(value); }
+		static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+		static Vector subtract(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+		static Vector divide(Vector a, Vector b) { return _mm256_div_ps(a, b); }
+		static Vector lessEqual(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static Vector greaterEqual(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static Vector less(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static Vector greater(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static Vector both(Vector a, Vector b) { return _mm256_and_ps(a, b); }
+		static Vector either(Vector a, Vector b) { return _mm256_or_ps(a, b); }
+		static Vector butNot(Vector a, Vector b) { return _mm256_andnot_ps(b, a); }
+		static Vector select(Vector mask, Vector a, Vector b) { return _mm256_blendv_ps(b, a, mask); }
+		static uint32_t bits(Vector mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask)); }
+	};
+#elif defined(__SSE2__) || defined(_M_X64)
+#define AITA_BATCH_SIMD
+	struct Lanes
+	{
+		using Vector = __m128;
+		constexpr static size_t Width = 4;
+
+		static Vector load(const float* source) { return _mm_loadu_ps(source); }
+		static void store(float* destination, Vector value) { _mm_storeu_ps(destination, value); }
+		static Vector broadcast(float value) { return _mm_set1_ps(value); }
+		static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+		static Vector subtract(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+		static Vector divide(Vector a, Vector b) { return _mm_div_ps(a, b); }
+		static Vector lessEqual(Vector a, Vector b) { return _mm_cmple_ps(a, b); }
+		static Vector greaterEqual(Vector a, Vector b) { return _mm_cmpge_ps(a, b); }
+		static Vector less(Vector a, Vector b) { return _mm_cmplt_ps(a, b); }
+		static Vector greater(Vector a, Vector b) { return _mm_cmpgt_ps(a, b); }
+		static Vector both(Vector a, Vector b) { return _mm_and_ps(a, b); }
+		static Vector either(Vector a, Vector b) { return _mm_or_ps(a, b); }
+		static Vector butNot(Vector a, Vector b) { return _mm_andnot_ps(b, a); }
+		static Vector select(Vector mask, Vector a, Vector b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+		static uint32_t bits(Vector mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask)); }
+	};
+#endif
+
+	BatchPhysics::BatchPhysics(const Configuration& config, size_t size) :
+		_config(config),
+		_physics(config),
+		_size(size),
+		_positionX(size),
+		_positionY(size),
+		_velocityX(size),
+		_velocityY(size),
+		_collision(size)
+	{
+		reset();
+	}
+
+	size_t BatchPhysics::size() const
+	{
+		return _size;
+	}
+
+	const Physics& BatchPhysics::physics() const
+	{
+		return _physics;
+	}
+
+	void BatchPhysics::reset()
+	{
+		const Body spawn = _physics.spawn();
+
+		for (size_t i = 0; i < _size; ++i)
+		{
+			setBody(i, spawn);
+		}
+	}
+
+	void BatchPhysics::control(size_t index, const Controls& controls)
+	{
+		setBody(index, _physics.control(body(index), controls));
+	}
+
+	void BatchPhysics::step()
+	{
+		size_t index = 0;
+
+#ifdef AITA_BATCH_SIMD
+		using Vector = Lanes::Vector;
+
+		const Vector zero = Lanes::broadcast(0.0f);
+		const Vector minimumX = Lanes::broadcast(_physics.MinimumX);
+		const Vector maximumX = Lanes::broadcast(_physics.MaximumX);
+		const Vector minimumY = Lanes::broadcast(_physics.MinimumY);
+		const Vector maximumY = Lanes::broadcast(_physics.MaximumY);
+		const Vector radius = Lanes::broadcast(_physics.Radius);
+		const Vector diameter = Lanes::broadcast(_physics.Diameter);
+		const Vector friction = Lanes::broadcast(_config.Friction);
+		const Vector gravity = Lanes::broadcast(_config.Gravity);
+		const Vector fenceTop = Lanes::broadcast(_config.FenceY - _physics.Diameter);
+		const Vector fenceLeft = Lanes::broadcast(_config.FenceLeft);
+		const Vector fenceMiddle = Lanes::broadcast(_config.FenceMiddle);
+		const Vector fenceRight = Lanes::broadcast(_config.FenceRight);
+		const Vector penaltyX = Lanes::broadcast(_config.HitPenaltyHorizontal);
+		const Vector penaltyY = Lanes::broadcast(_config.HitPenaltyVertical);
+
+		for (; index + Lanes::Width <= _size; index += Lanes::Width)
+		{
+			Vector positionX = Lanes::load(&_positionX[index]);
+			Vector positionY = Lanes::load(&_positionY[index]);
+			Vector velocityX = Lanes::load(&_velocityX[index]);
+			Vector velocityY = Lanes::load(&_velocityY[index]);
+
+			positionX = Lanes::add(positionX, velocityX);
+			positionY = Lanes::add(positionY, velocityY);
+
+			// Boundary collision / clamping, friction is applied only when not touching a wall
+			const Vector leftWall = Lanes::lessEqual(positionX, minimumX);
+			const Vector rightWall = Lanes::butNot(Lanes::greaterEqual(positionX, maximumX), leftWall);
+			positionX = Lanes::select(leftWall, minimumX, Lanes::select(rightWall, maximumX, positionX));
+			velocityX = Lanes::select(Lanes::either(leftWall, rightWall), zero, Lanes::divide(velocityX, friction));
+
+			// Same for ceiling and ground, gravity is applied only when airborne
+			const Vector ceiling = Lanes::lessEqual(positionY, minimumY);
+			const Vector ground = Lanes::butNot(Lanes::greaterEqual(positionY, maximumY), ceiling);
+			positionY = Lanes::select(ceiling, minimumY, Lanes::select(ground, maximumY, positionY));
+			velocityY = Lanes::select(Lanes::either(ceiling, ground), zero, Lanes::add(velocityY, gravity));
+
+			// Fence collision
+			const Vector playerRight = Lanes::add(positionX, diameter);
+			const Vector playerCenter = Lanes::add(positionX, radius);
+
+			const Vector overlap = Lanes::both(
+				Lanes::both(Lanes::greater(positionY, fenceTop), Lanes::greater(playerRight, fenceLeft)),
+				Lanes::less(positionX, fenceRight));
+
+			const Vector hitLeft = Lanes::both(overlap, Lanes::less(playerCenter, fenceMiddle));
+			const Vector hitRight = Lanes::both(overlap, Lanes::greater(playerCenter, fenceMiddle));
+
+			// Select instead of adding a masked penalty, adding zero would not preserve negative zeros
+			positionX = Lanes::select(hitLeft, Lanes::subtract(positionX, penaltyX),
+				Lanes::select(hitRight, Lanes::add(positionX, penaltyX), positionX));
+			positionY = Lanes::select(Lanes::either(hitLeft, hitRight), Lanes::add(positionY, penaltyY), positionY);
+
+			Lanes::store(&_positionX[index], positionX);
+			Lanes::store(&_positionY[index], positionY);
+			Lanes::store(&_velocityX[index], velocityX);
+			Lanes::store(&_velocityY[index], velocityY);
+
+			const uint32_t overlapBits = Lanes::bits(overlap);
+			const uint32_t leftBits = Lanes::bits(hitLeft);
+			const uint32_t rightBits = Lanes::bits(hitRight);
+
+			for (size_t lane = 0; lane < Lanes::Width; ++lane)
+			{
+				Collision& collision = _collision[index + lane];
+
+				if (!(overlapBits >> lane & 1))
+				{
+					collision = Collision::None;
+				}
+				else if (leftBits >> lane & 1)
+				{
+					collision = Collision::Left;
+				}
+				else if (rightBits >> lane & 1)
+				{
+					collision = Collision::Right;
+				}
+			}
+		}
+#endif
+		stepScalar(index, _size);
+	}
+
+	Body BatchPhysics::body(size_t index) const
+	{
+		return
+		{
+			{ _positionX[index], _positionY[index] },
+			{ _velocityX[index], _velocityY[index] },
+			_collision[index]
+		};
+	}
+
+	void BatchPhysics::setBody(size_t index, const Body& body)
+	{
+		_positionX[index] = body.position.x;
+		_positionY[index] = body.position.y;
+		_velocityX[index] = body.velocity.x;
+		_velocityY[index] = body.velocity.y;
+		_collision[index] = body.collision;
+	}
+
+	void BatchPhysics::stepScalar(size_t from, size_t to)
+	{
+		for (size_t i = from; i < to; ++i)
+		{
+			setBody(i, _physics.step(body(i)));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Simulation.hpp"
+
+namespace aita
+{
+	// Steps many independent players at once. The state is kept as a structure of arrays
+	// so that the whole batch can be advanced with SIMD. The results are bit-identical to Physics::step().
+	class BatchPhysics
+	{
+	public:
+		BatchPhysics(const Configuration& config, size_t size);
+
+		size_t size() const;
+		const Physics& physics() const;
+
+		void reset();
+		void control(size_t index, const Controls& controls);
+		void step();
+
+		Body body(size_t index) const;
+		void setBody(size_t index, const Body& body);
+
+	private:
+		void stepScalar(size_t from, size_t to);
+
+		const Configuration& _config;
+		const Physics _physics;
+		const size_t _size;
+
+		std::vector<float> _positionX;
+		std::vector<float> _positionY;
+		std::vector<float> _velocityX;
+		std::vector<float> _velocityY;
+		std::vector<Collision> _collision;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "Futex.hpp"
+
+namespace aita
+{
+#ifndef __linux__
+	namespace
+	{
+		// Without a futex the waiter polls the word, so a wake up is late by at most this much
+		void pollingWait(const std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout)
+		{
+			if (word.load() == expected)
+			{
+				std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(timeout, std::chrono::microseconds(50)));
+			}
+		}
+	}
+#endif
+
+#ifdef WIN32
+	void futexWait(const std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout, FutexScope scope)
+	{
+		// WaitOnAddress does not see other processes
+		if (scope == FutexScope::Shared)
+		{
+			pollingWait(word, expected, timeout);
+			return;
+		}
+
+		const auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(timeout);
+		WaitOnAddress(const_cast<std::atomic<uint32_t>*>(&word), &expected, sizeof(expected), static_cast<DWORD>(milliseconds.count()));
+	}
+
+	void futexWake(const std::atomic<uint32_t>& word, FutexScope scope)
+	{
+		if (scope == FutexScope::Private)
+		{
+			WakeByAddressAll(const_cast<std::atomic<uint32_t>*>(&word));
+		}
+	}
+#elif defined(__linux__)
+	void futexWait(const std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout, FutexScope scope)
+	{
+		const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+		const timespec relative = { seconds.count(), (timeout - seconds).count() };
+		const int operation = scope == FutexScope::Shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+
+		syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), operation, expected, &relative, nullptr, 0);
+	}
+
+	void futexWake(const std::atomic<uint32_t>& word, FutexScope scope)
+	{
+		const int operation = scope == FutexScope::Shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+
+		syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), operation, INT_MAX, nullptr, nullptr, 0);
+	}
+#else
+	void futexWait(const std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout, FutexScope scope)
+	{
+		pollingWait(word, expected, timeout);
+	}
+
+	void futexWake(const std::atomic<uint32_t>& word, FutexScope scope)
+	{
+	}
+#endif
+}
\ No newline at end of file
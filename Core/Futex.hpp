@@ -0,0 +1,15 @@
+#pragma once
+
+namespace aita
+{
+	// A private word is only touched by threads of this process, a shared one lives in memory mapped by another process
+	enum class FutexScope
+	{
+		Private,
+		Shared
+	};
+
+	// Sleeps while the word holds the expected value, at most for the timeout. May return early.
+	void futexWait(const std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout, FutexScope scope);
+	void futexWake(const std::atomic<uint32_t>& word, FutexScope scope);
+}
\ No newline at end of file
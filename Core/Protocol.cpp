@@ -0,0 +1,184 @@
+#include "Protocol.hpp"
+
+namespace aita
+{
+	namespace
+	{
+		// Byte offsets of the StateRecord fields, the rest of the record is zero padding
+		constexpr size_t FrameOffset = 0;
+		constexpr size_t PositionXOffset = 8;
+		constexpr size_t PositionYOffset = 12;
+		constexpr size_t VelocityXOffset = 16;
+		constexpr size_t VelocityYOffset = 20;
+		constexpr size_t ResultOffset = 24;
+		constexpr size_t CollisionOffset = 25;
+
+		// Byte offsets of the ActionRecord fields
+		constexpr size_t CommandOffset = 0;
+		constexpr size_t KeysOffset = 1;
+		constexpr size_t FramesOffset = 2;
+
+		// Bits of the ActionRecord keys field
+		constexpr uint8_t LeftKey = 1 << 0;
+		constexpr uint8_t RightKey = 1 << 1;
+		constexpr uint8_t UpKey = 1 << 2;
+		constexpr uint8_t DownKey = 1 << 3;
+		constexpr uint8_t JumpKey = 1 << 4;
+
+		template <typename T>
+		void storeLittleEndian(char* destination, T value)
+		{
+			if constexpr (std::endian::native == std::endian::big)
+			{
+				value = std::byteswap(value);
+			}
+
+			std::memcpy(destination, &value, sizeof(T));
+		}
+
+		template <typename T>
+		T loadLittleEndian(const char* source)
+		{
+			T value;
+			std::memcpy(&value, source, sizeof(T));
+
+			if constexpr (std::endian::native == std::endian::big)
+			{
+				value = std::byteswap(value);
+			}
+
+			return value;
+		}
+
+		void storeFloat(char* destination, float value)
+		{
+			storeLittleEndian(destination, std::bit_cast<uint32_t>(value));
+		}
+
+		float loadFloat(const char* source)
+		{
+			return std::bit_cast<float>(loadLittleEndian<uint32_t>(source));
+		}
+	}
+
+	Protocol parseProtocol(std::string_view name)
+	{
+		if (name == "text")
+		{
+			return Protocol::Text;
+		}
+
+		if (name == "binary")
+		{
+			return Protocol::Binary;
+		}
+
+		throw std::invalid_argument("Unknown protocol: " + std::string(name));
+	}
+
+	Telemetry parseTelemetry(std::string_view name)
+	{
+		for (Telemetry telemetry : { Telemetry::Changes, Telemetry::Frame, Telemetry::Query })
+		{
+			if (name == telemetryName(telemetry))
+			{
+				return telemetry;
+			}
+		}
+
+		throw std::invalid_argument("Unknown telemetry: " + std::string(name));
+	}
+
+	std::string_view telemetryName(Telemetry telemetry)
+	{
+		switch (telemetry)
+		{
+			case Telemetry::Frame:
+				return "frame";
+			case Telemetry::Query:
+				return "query";
+			default:
+				return "changes";
+		}
+	}
+
+	StateRecord StateRecord::capture(uint64_t frame, const Body& body, Result result)
+	{
+		return { frame, body.position, body.velocity, result, body.collision };
+	}
+
+	void StateRecord::encode(std::span<char, Size> buffer) const
+	{
+		std::ranges::fill(buffer, '\0');
+
+		char* data = buffer.data();
+		storeLittleEndian(data + FrameOffset, frame);
+		storeFloat(data + PositionXOffset, position.x);
+		storeFloat(data + PositionYOffset, position.y);
+		storeFloat(data + VelocityXOffset, velocity.x);
+		storeFloat(data + VelocityYOffset, velocity.y);
+		data[ResultOffset] = static_cast<char>(result);
+		data[CollisionOffset] = static_cast<char>(collision);
+	}
+
+	StateRecord StateRecord::decode(std::span<const char, Size> buffer)
+	{
+		const char* data = buffer.data();
+
+		StateRecord record;
+		record.frame = loadLittleEndian<uint64_t>(data + FrameOffset);
+		record.position = { loadFloat(data + PositionXOffset), loadFloat(data + PositionYOffset) };
+		record.velocity = { loadFloat(data + VelocityXOffset), loadFloat(data + VelocityYOffset) };
+		record.result = static_cast<Result>(data[ResultOffset]);
+		record.collision = static_cast<Collision>(data[CollisionOffset]);
+		return record;
+	}
+
+	ActionRecord ActionRecord::advance(const Controls& controls, uint16_t frames)
+	{
+		return { Command::Advance, controls, frames };
+	}
+
+	ActionRecord ActionRecord::reset()
+	{
+		return { Command::Reset, {}, 0 };
+	}
+
+	ActionRecord ActionRecord::query()
+	{
+		return { Command::Query, {}, 0 };
+	}
+
+	void ActionRecord::encode(std::span<char, Size> buffer) const
+	{
+		std::ranges::fill(buffer, '\0');
+
+		uint8_t keys = 0;
+		keys |= controls.left ? LeftKey : 0;
+		keys |= controls.right ? RightKey : 0;
+		keys |= controls.up ? UpKey : 0;
+		keys |= controls.down ? DownKey : 0;
+		keys |= controls.jump ? JumpKey : 0;
+
+		char* data = buffer.data();
+		data[CommandOffset] = static_cast<char>(command);
+		data[KeysOffset] = static_cast<char>(keys);
+		storeLittleEndian(data + FramesOffset, frames);
+	}
+
+	ActionRecord ActionRecord::decode(std::span<const char, Size> buffer)
+	{
+		const char* data = buffer.data();
+		const uint8_t keys = static_cast<uint8_t>(data[KeysOffset]);
+
+		ActionRecord record;
+		record.command = static_cast<Command>(data[CommandOffset]);
+		record.controls.left = keys & LeftKey;
+		record.controls.right = keys & RightKey;
+		record.controls.up = keys & UpKey;
+		record.controls.down = keys & DownKey;
+		record.controls.jump = keys & JumpKey;
+		record.frames = loadLittleEndian<uint16_t>(data + FramesOffset);
+		return record;
+	}
+}
\ No newline at end of file
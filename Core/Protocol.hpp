@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Simulation.hpp"
+
+namespace aita
+{
+	enum class Protocol : uint8_t
+	{
+		Text = 0,
+		Binary
+	};
+
+	Protocol parseProtocol(std::string_view name);
+
+	// When the game reports its state outside of lockstep
+	enum class Telemetry : uint8_t
+	{
+		Changes = 0, // When the player moves and once a second
+		Frame, // Every frame
+		Query // Like Changes, and within a frame of a query command on stdin
+	};
+
+	Telemetry parseTelemetry(std::string_view name);
+	std::string_view telemetryName(Telemetry telemetry);
+
+	// The fixed-size little-endian record the game writes per reported frame with --protocol=binary.
+	// The frame number increases monotonically over the lifetime of the game process.
+	struct StateRecord
+	{
+		constexpr static size_t Size = 32;
+
+		uint64_t frame = 0;
+		Vector2 position;
+		Vector2 velocity;
+		Result result = Result::None;
+		Collision collision = Collision::None;
+
+		static StateRecord capture(uint64_t frame, const Body& body, Result result);
+
+		void encode(std::span<char, Size> buffer) const;
+		static StateRecord decode(std::span<const char, Size> buffer);
+	};
+
+	enum class Command : uint8_t
+	{
+		Advance = 0, // Hold the keys for the given number of frames (jump on the first one), then report one state record
+		Reset, // Start a new episode right away and report its first frame
+		Query // Report the current state without advancing
+	};
+
+	// The fixed-size little-endian record aitaRL writes to the game's stdin with --lockstep.
+	// The game answers every command with exactly one StateRecord.
+	struct ActionRecord
+	{
+		constexpr static size_t Size = 8;
+
+		Command command = Command::Advance;
+		Controls controls;
+		uint16_t frames = 1; // Zero reports the current state without advancing
+
+		static ActionRecord advance(const Controls& controls, uint16_t frames);
+		static ActionRecord reset();
+		static ActionRecord query();
+
+		void encode(std::span<char, Size> buffer) const;
+		static ActionRecord decode(std::span<const char, Size> buffer);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "SharedRing.hpp"
+#include "Futex.hpp"
+
+namespace aita
+{
+	struct SharedRing::Layout
+	{
+		struct Slot
+		{
+			int64_t timestamp;
+			char record[StateRecord::Size];
+		};
+
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+		alignas(64) std::atomic<uint32_t> signal;
+		std::atomic<uint32_t> sleeping;
+		std::atomic<uint64_t> dropped;
+		Slot slots[Capacity];
+	};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "The ring is shared between processes");
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "The ring is shared between processes");
+
+	namespace
+	{
+		int64_t timestamp()
+		{
+			const auto now = std::chrono::steady_clock::now().time_since_epoch();
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+		}
+	}
+
+#ifdef WIN32
+	SharedRing::SharedRing(const std::string& name, bool create) :
+		_name(name),
+		_owner(create)
+	{
+		throw std::runtime_error("Shared memory transport is only supported on POSIX systems");
+	}
+
+	SharedRing::~SharedRing()
+	{
+	}
+#else
+	SharedRing::SharedRing(const std::string& name, bool create) :
+		_name(name),
+		_owner(create)
+	{
+		const int flags = create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR;
+		const int descriptor = shm_open(name.c_str(), flags, 0600);
+
+		if (descriptor == -1)
+		{
+			throw std::system_error(errno, std::system_category(), "Failed to open shared memory " + name);
+		}
+
+		if (create && ftruncate(descriptor, sizeof(Layout)) == -1)
+		{
+			const int error = errno;
+			close(descriptor);
+			shm_unlink(name.c_str());
+			throw std::system_error(error, std::system_category(), "Failed to size shared memory " + name);
+		}
+
+		void* memory = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		const int error = errno;
+
+		// The mapping keeps the memory alive
+		close(descriptor);
+
+		if (memory == MAP_FAILED)
+		{
+			if (create)
+			{
+				shm_unlink(name.c_str());
+			}
+
+			throw std::system_error(error, std::system_category(), "Failed to map shared memory " + name);
+		}
+
+		_layout = create ? new (memory) Layout() : static_cast<Layout*>(memory);
+	}
+
+	SharedRing::~SharedRing()
+	{
+		munmap(_layout, sizeof(Layout));
+
+		if (_owner)
+		{
+			shm_unlink(_name.c_str());
+		}
+	}
+#endif
+
+	bool SharedRing::push(const StateRecord& record)
+	{
+		const uint64_t head = _layout->head.load(std::memory_order_relaxed);
+
+		if (head - _layout->tail.load(std::memory_order_acquire) >= Capacity)
+		{
+			_layout->dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		Layout::Slot& slot = _layout->slots[head % Capacity];
+		record.encode(slot.record);
+		slot.timestamp = timestamp();
+
+		_layout->head.store(head + 1, std::memory_order_release);
+		_layout->signal.fetch_add(1);
+
+		if (_layout->sleeping.load())
+		{
+			futexWake(_layout->signal, FutexScope::Shared);
+		}
+
+		return true;
+	}
+
+	bool SharedRing::pop(StateRecord& record, std::chrono::steady_clock::time_point& pushed)
+	{
+		const uint64_t tail = _layout->tail.load(std::memory_order_relaxed);
+
+		if (tail == _layout->head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		const Layout::Slot& slot = _layout->slots[tail % Capacity];
+		record = StateRecord::decode(slot.record);
+		pushed = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(slot.timestamp)));
+
+		_layout->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool SharedRing::wait(std::chrono::milliseconds timeout)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+		while (true)
+		{
+			// Any push after this load changes the signal, so the futex wait below cannot miss it
+			const uint32_t signal = _layout->signal.load();
+
+			if (_layout->head.load() != _layout->tail.load(std::memory_order_relaxed))
+			{
+				return true;
+			}
+
+			const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+			if (remaining <= std::chrono::milliseconds(0))
+			{
+				return false;
+			}
+
+			_layout->sleeping.store(1);
+			futexWait(_layout->signal, signal, remaining, FutexScope::Shared);
+			_layout->sleeping.store(0);
+		}
+	}
+
+	uint64_t SharedRing::dropped() const
+	{
+		return _layout->dropped.load(std::memory_order_relaxed);
+	}
+
+	const std::string& SharedRing::name() const
+	{
+		return _name;
+	}
+}
\ No newline at end of file
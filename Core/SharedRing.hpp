@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Protocol.hpp"
+
+namespace aita
+{
+	// Single-producer/single-consumer ring of state records in POSIX shared memory.
+	// The consumer (aitaRL) creates the memory, the producer (the game) opens it by name.
+	// Pushing only makes a system call when the consumer is asleep waiting for data.
+	class SharedRing
+	{
+	public:
+		constexpr static uint64_t Capacity = 1024;
+
+		SharedRing(const std::string& name, bool create);
+		~SharedRing();
+
+		SharedRing(const SharedRing&) = delete;
+		SharedRing& operator = (const SharedRing&) = delete;
+		SharedRing(SharedRing&&) = delete;
+		SharedRing& operator = (SharedRing&&) = delete;
+
+		// Returns false and drops the record if the consumer has fallen a whole ring behind
+		bool push(const StateRecord& record);
+
+		// Returns false if the ring is empty. The producer pushed the record at the given time.
+		bool pop(StateRecord& record, std::chrono::steady_clock::time_point& pushed);
+
+		// Blocks until the ring is not empty or the timeout expires
+		bool wait(std::chrono::milliseconds timeout);
+
+		uint64_t dropped() const;
+		const std::string& name() const;
+
+	private:
+		struct Layout;
+
+		const std::string _name;
+		const bool _owner;
+		Layout* _layout = nullptr;
+	};
+}
\ No newline at end of file
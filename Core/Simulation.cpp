@@ -0,0 +1,245 @@
+#include "Simulation.hpp"
+
+namespace aita
+{
+	Configuration::Configuration(float width, float height) :
+		WindowWidth(width),
+		WindowHeight(height),
+		FenceWidth(WindowWidth / 40.0f),
+		FenceHeight(WindowHeight / 3.0f),
+		FenceHalf(FenceWidth / 2.0f),
+		FenceX(WindowWidth / 2 - FenceHalf),
+		FenceY(WindowHeight - FenceHeight),
+		FenceLeft(FenceX),
+		FenceMiddle(FenceLeft + FenceHalf),
+		FenceRight(FenceLeft + FenceWidth),
+		Gravity(WindowHeight / 1200.0f),
+		JumpVelocity(-(WindowHeight / 37.5f)),
+		Friction(WindowWidth / 100.0f),
+		MoveVelocity(WindowWidth / 160.0f),
+		HitPenaltyHorizontal(WindowWidth / 53.33f),
+		HitPenaltyVertical(WindowHeight / 60.0f)
+	{
+	}
+
+	Physics::Physics(const Configuration& config) :
+		Radius((config.WindowWidth + config.WindowHeight) / 35.0f),
+		Diameter(Radius * 2.0f),
+		MinimumX(0.0f),
+		MaximumX(config.WindowWidth - Diameter),
+		MinimumY(0.0f),
+		MaximumY(config.WindowHeight - Diameter),
+		_config(config)
+	{
+	}
+
+	Body Physics::spawn() const
+	{
+		return { { MinimumX, MaximumY }, { 0.0f, 0.0f }, Collision::None };
+	}
+
+	Body Physics::jump(Body body) const
+	{
+		// Is on ground level
+		if (body.position.y >= MaximumY)
+		{
+			body.velocity.y = _config.JumpVelocity;
+		}
+
+		return body;
+	}
+
+	Body Physics::move(Body body, Vector2 direction) const
+	{
+		body.velocity += direction;
+		return body;
+	}
+
+	Body Physics::control(Body body, const Controls& controls) const
+	{
+		if (controls.jump)
+		{
+			body = jump(body);
+		}
+
+		if (controls.right)
+		{
+			body = move(body, { _config.MoveVelocity, 0.0f });
+		}
+
+		if (controls.left)
+		{
+			body = move(body, { -_config.MoveVelocity, 0.0f });
+		}
+
+		if (_config.Gravity > 0.0f)
+		{
+			return body;
+		}
+
+		if (controls.up)
+		{
+			body = move(body, { 0.0f, -_config.MoveVelocity });
+		}
+
+		if (controls.down)
+		{
+			body = move(body, { 0.0f, _config.MoveVelocity });
+		}
+
+		return body;
+	}
+
+	Body Physics::step(Body body) const
+	{
+		Vector2& position = body.position;
+		Vector2& velocity = body.velocity;
+
+		position += velocity;
+
+		// Boundary collision / clamping
+		if (position.x <= MinimumX)
+		{
+			position.x = MinimumX;
+			velocity.x = 0.0f;
+		}
+		else if (position.x >= MaximumX)
+		{
+			position.x = MaximumX;
+			velocity.x = 0.0f;
+		}
+		else
+		{
+			// Apply friction
+			velocity.x /= _config.Friction;
+		}
+
+		if (position.y <= MinimumY)
+		{
+			position.y = MinimumY;
+			velocity.y = 0.0f;
+		}
+		else if (position.y >= MaximumY)
+		{
+			position.y = MaximumY;
+			velocity.y = 0.0f;
+		}
+		else
+		{
+			// Apply gravity
+			velocity.y += _config.Gravity;
+		}
+
+		const float playerLeft = position.x;
+		const float playerRight = position.x + Diameter;
+		const float playerCenter = position.x + Radius;
+
+		// Fence collision
+		if (position.y > _config.FenceY - Diameter &&
+			playerRight > _config.FenceLeft &&
+			playerLeft < _config.FenceRight)
+		{
+			if (playerCenter < _config.FenceMiddle)
+			{
+				body.collision = Collision::Left;
+				position.x -= _config.HitPenaltyHorizontal;
+				position.y += _config.HitPenaltyVertical;
+			}
+
+			if (playerCenter > _config.FenceMiddle)
+			{
+				body.collision = Collision::Right;
+				position.x += _config.HitPenaltyHorizontal;
+				position.y += _config.HitPenaltyVertical;
+			}
+		}
+		else
+		{
+			// Higher than fence
+			body.collision = Collision::None;
+		}
+
+		return body;
+	}
+
+	Vector2 Physics::bottomRight(const Body& body) const
+	{
+		return { body.position.x + Diameter, body.position.y + Diameter };
+	}
+
+	bool Physics::isMoving(const Body& body) const
+	{
+		constexpr float minVelocity = 0.1f;
+		return (body.velocity.x > minVelocity || body.velocity.x < -minVelocity) ||
+			(body.velocity.y > minVelocity || body.velocity.y < -minVelocity);
+	}
+
+	bool Physics::hasFinished(const Body& body) const
+	{
+		const Vector2 corner = bottomRight(body);
+		return corner.x >= _config.WindowWidth && corner.y >= _config.WindowHeight;
+	}
+
+	Episode::Episode(const Configuration& config) :
+		_physics(config),
+		_body(_physics.spawn())
+	{
+	}
+
+	void Episode::reset()
+	{
+		_body = _physics.spawn();
+		_score = Configuration::MaxScore;
+		_frame = 0;
+		_result = Result::None;
+	}
+
+	Result Episode::advance(const Controls& controls)
+	{
+		if (_result != Result::None)
+		{
+			return _result;
+		}
+
+		_body = _physics.step(_physics.control(_body, controls));
+		++_frame;
+
+		// The score is inversely proportional to the time taken to finish the game
+		// Higher score equals less time taken to make the jump
+		if (_physics.hasFinished(_body))
+		{
+			_result = Result::Won;
+		}
+		else if (--_score <= 0)
+		{
+			_result = Result::Lost;
+		}
+
+		return _result;
+	}
+
+	const Physics& Episode::physics() const
+	{
+		return _physics;
+	}
+
+	const Body& Episode::body() const
+	{
+		return _body;
+	}
+
+	int32_t Episode::score() const
+	{
+		return _score;
+	}
+
+	uint32_t Episode::frame() const
+	{
+		return _frame;
+	}
+
+	Result Episode::result() const
+	{
+		return _result;
+	}
+}
\ No newline at end of file
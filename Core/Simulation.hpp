@@ -0,0 +1,131 @@
+#pragma once
+
+namespace aita
+{
+	struct Configuration
+	{
+		constexpr static uint32_t FramesPerSecond = 30;
+		constexpr static float DefaultWindowWidth = 800.0f;
+		constexpr static float DefaultWindowHeight = 600.0f;
+		constexpr static int32_t MaxScore = FramesPerSecond * 10;
+
+		const float WindowWidth;
+		const float WindowHeight;
+
+		const float FenceWidth;
+		const float FenceHeight;
+		const float FenceHalf;
+		const float FenceX;
+		const float FenceY;
+		const float FenceLeft;
+		const float FenceMiddle;
+		const float FenceRight;
+
+		float Gravity;
+		const float JumpVelocity;
+
+		float Friction;
+		const float MoveVelocity;
+
+		const float HitPenaltyHorizontal;
+		const float HitPenaltyVertical;
+
+		Configuration(float width, float height);
+	};
+
+	enum class Result : uint8_t
+	{
+		None = 0,
+		Lost,
+		Won
+	};
+
+	enum class Collision : uint8_t
+	{
+		None = 0,
+		Left,
+		Right
+	};
+
+	struct Vector2
+	{
+		float x = 0.0f;
+		float y = 0.0f;
+
+		constexpr Vector2& operator += (const Vector2& other)
+		{
+			x += other.x;
+			y += other.y;
+			return *this;
+		}
+	};
+
+	// The keys held down (or in case of jump, pressed) during a single frame
+	struct Controls
+	{
+		bool left = false;
+		bool right = false;
+		bool up = false;
+		bool down = false;
+		bool jump = false;
+
+		bool operator == (const Controls&) const = default;
+	};
+
+	struct Body
+	{
+		Vector2 position;
+		Vector2 velocity;
+		Collision collision = Collision::None;
+	};
+
+	// Render-free player physics. All functions are pure: they take a body and return the next one.
+	class Physics
+	{
+	public:
+		const float Radius;
+		const float Diameter;
+		const float MinimumX;
+		const float MaximumX;
+		const float MinimumY;
+		const float MaximumY;
+
+		Physics(const Configuration& config);
+
+		Body spawn() const;
+		Body jump(Body body) const;
+		Body move(Body body, Vector2 direction) const;
+		Body control(Body body, const Controls& controls) const;
+		Body step(Body body) const;
+
+		Vector2 bottomRight(const Body& body) const;
+		bool isMoving(const Body& body) const;
+		bool hasFinished(const Body& body) const;
+
+	private:
+		const Configuration& _config;
+	};
+
+	// A single jump attempt, advanced one frame at a time
+	class Episode
+	{
+	public:
+		Episode(const Configuration& config);
+
+		void reset();
+		Result advance(const Controls& controls);
+
+		const Physics& physics() const;
+		const Body& body() const;
+		int32_t score() const;
+		uint32_t frame() const;
+		Result result() const;
+
+	private:
+		Physics _physics;
+		Body _body;
+		int32_t _score = Configuration::MaxScore;
+		uint32_t _frame = 0;
+		Result _result = Result::None;
+	};
+}
\ No newline at end of file
@@ -2,178 +2,122 @@
 
 namespace aita
 {
-	Configuration::Configuration(float width, float height) :
-		WindowWidth(width),
-		WindowHeight(height),
-		FenceWidth(WindowWidth / 40.0f),
-		FenceHeight(WindowHeight / 3.0f),
-		FenceHalf(FenceWidth / 2.0f),
-		FenceX(WindowWidth / 2 - FenceHalf),
-		FenceY(WindowHeight - FenceHeight),
-		FenceLeft(FenceX),
-		FenceMiddle(FenceLeft + FenceHalf),
-		FenceRight(FenceLeft + FenceWidth),
-		Gravity(WindowHeight / 1200.0f),
-		JumpVelocity(-(WindowHeight / 37.5f)),
-		Friction(WindowWidth / 100.0f),
-		MoveVelocity(WindowWidth / 160.0f),
-		HitPenaltyHorizontal(WindowWidth / 53.33f),
-		HitPenaltyVertical(WindowHeight / 60.0f)
+	Player::Player(const Physics& physics) :
+		_shape(physics.Radius, 8)
 	{
+		update(physics.spawn());
 	}
 
-	Player::Player(const Configuration& config) :
-		Radius((config.WindowWidth + config.WindowHeight) / 35.0f),
-		Diameter(Radius * 2.0f),
-		MinimumX(0.0f),
-		MaximumX(config.WindowWidth - Diameter),
-		MinimumY(0.0f),
-		MaximumY(config.WindowHeight - Diameter),
-		_config(config),
-		_shape(Radius, 8),
-		_position(MinimumX, MaximumY),
-		_velocity(0.0f, 0.0f)
+	void Player::update(const Body& body)
 	{
-		_shape.setPosition(_position);
-		_shape.setFillColor(sf::Color::Green);
+		_shape.setPosition({ body.position.x, body.position.y });
+
+		switch (body.collision)
+		{
+			case Collision::Left:
+				_shape.setFillColor(sf::Color::Blue);
+				break;
+			case Collision::Right:
+				_shape.setFillColor(sf::Color::Magenta);
+				break;
+			default:
+				// Higher than fence
+				_shape.setFillColor(sf::Color::Green);
+				break;
+		}
 	}
 
-	void Player::reset()
+	void Player::draw(sf::RenderTarget& target, sf::RenderStates states) const
 	{
-		_position = { MinimumX, MaximumY };
-		_velocity = { 0.0f, 0.0f };
-		_shape.setPosition(_position);
+		target.draw(_shape, states);
 	}
 
-	void Player::jump()
+	FixedTimestep::FixedTimestep(float speed) :
+		_step(speed > 0.0f ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / Configuration::FramesPerSecond / speed)) : Clock::duration::zero())
 	{
-		// Is on ground level
-		if (_position.y >= MaximumY)
-		{
-			_velocity.y = _config.JumpVelocity;
-		}
+		restart();
 	}
 
-	void Player::move(sf::Vector2f direction)
+	void FixedTimestep::restart()
 	{
-		_velocity += direction;
+		_previous = Clock::now();
+		_accumulated = Clock::duration::zero();
 	}
 
-	void Player::update()
+	uint16_t FixedTimestep::due()
 	{
-		_position += _velocity;
-
-		// Boundary collision / clamping
-		if (_position.x <= MinimumX)
-		{
-			_position.x = MinimumX;
-			_velocity.x = 0.0f;
-		}
-		else if (_position.x >= MaximumX)
-		{
-			_position.x = MaximumX;
-			_velocity.x = 0.0f;
-		}
-		else
+		// The keys are read once per update, so a single frame keeps the trajectory that of a paced run
+		if (_step == Clock::duration::zero())
 		{
-			// Apply friction
-			_velocity.x /= _config.Friction;
+			return 1;
 		}
 
-		if (_position.y <= MinimumY)
-		{
-			_position.y = MinimumY;
-			_velocity.y = 0.0f;
-		}
-		else if (_position.y >= MaximumY)
-		{
-			_position.y = MaximumY;
-			_velocity.y = 0.0f;
-		}
-		else
+		Clock::time_point now = Clock::now();
+
+		if (_accumulated + (now - _previous) < _step)
 		{
-			// Apply gravity
-			_velocity.y += _config.Gravity;
+			std::this_thread::sleep_until(_previous + (_step - _accumulated));
+			now = Clock::now();
 		}
 
-		_shape.setPosition(_position);
+		// A stalled loop gives up the time it could not catch up with, the trajectory stays the same
+		_accumulated = std::min(_accumulated + (now - _previous), _step * MaxFramesPerUpdate);
+		_previous = now;
 
-		const float playerLeft = _position.x;
-		const float playerRight = _position.x + Diameter;
-		const float playerCenter = _position.x + Radius;
+		const auto frames = _accumulated / _step;
+		_accumulated -= _step * frames;
+		return static_cast<uint16_t>(frames);
+	}
 
-		// Fence collision
-		if (_position.y > _config.FenceY - Diameter &&
-			playerRight > _config.FenceLeft &&
-			playerLeft < _config.FenceRight)
+	Game::Game(float width, float height, const Settings& settings) :
+		Config(width, height),
+		_settings(settings),
+		_timestep(settings.speed),
+		_episode(Config),
+		_player(_episode.physics())
+	{
+		if (!_settings.headless)
 		{
-			if (playerCenter < _config.FenceMiddle)
-			{
-				_shape.setFillColor(sf::Color::Blue);
-				_position.x -= _config.HitPenaltyHorizontal;
-				_position.y += _config.HitPenaltyVertical;
-			}
+			sf::Vector2u resolution(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+			sf::VideoMode videoMode(resolution, 8);
 
-			if (playerCenter > _config.FenceMiddle)
-			{
-				_shape.setFillColor(sf::Color::Magenta);
-				_position.x += _config.HitPenaltyHorizontal;
-				_position.y += _config.HitPenaltyVertical;
-			}
-		}
-		else
-		{
-			// Higher than fence
-			_shape.setFillColor(sf::Color::Green);
+			_window = sf::RenderWindow(videoMode, "Aita on matalin - The Fence Jump Game");
+
+			// Only the render thread waits for the display, the simulation keeps its own pace
+			_window.setVerticalSyncEnabled(true);
+			_window.setFramerateLimit(Config.FramesPerSecond);
 		}
-	}
 
-	sf::Vector2f Player::bottomRight() const
-	{
-		return { _position.x + Diameter, _position.y + Diameter };
-	}
+		_fence = sf::RectangleShape({ Config.FenceWidth, Config.FenceHeight });
+		_fence.setFillColor(sf::Color::Red);
+		_fence.setPosition({ Config.FenceX, Config.FenceY });
 
-	void Player::draw(sf::RenderTarget& target, sf::RenderStates states) const
-	{
-		target.draw(_shape, states);
-	}
+		if (!_settings.sharedMemory.empty())
+		{
+			_ring = std::make_unique<SharedRing>(_settings.sharedMemory, false);
+		}
 
-	sf::Vector2f Player::position() const
-	{
-		return _position;
-	}
+		if (!_settings.lockstep && _settings.telemetry == Telemetry::Query)
+		{
+			listen();
+		}
 
-	sf::Vector2f Player::velocity() const
-	{
-		return _velocity;
+		if (!_settings.headless)
+		{
+			// The OpenGL context can only be active in one thread at a time
+			_window.setActive(false);
+			_renderer = std::jthread(std::bind(&Game::render, this));
+		}
 	}
 
-	bool Player::isMoving() const
+	Game::~Game()
 	{
-		constexpr float minVelocity = 0.1f;
-		return (_velocity.x > minVelocity || _velocity.x < -minVelocity) ||
-			(_velocity.y > minVelocity || _velocity.y < -minVelocity);
-	}
-
-	Game::Game(float width, float height) :
-		Config(width, height),
-		_player(Config)
-	{
-		sf::Vector2u resolution(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-		sf::VideoMode videoMode(resolution, 8);
-
-		_window = sf::RenderWindow(videoMode, "Aita on matalin - The Fence Jump Game");
-		_window.setVerticalSyncEnabled(true);
-		_window.setFramerateLimit(Config.FramesPerSecond);
-
-		_fence = sf::RectangleShape({ Config.FenceWidth, Config.FenceHeight });
-		_fence.setFillColor(sf::Color::Red);
-		_fence.setPosition({ Config.FenceX, Config.FenceY });
+		stopRendering();
 	}
 
 	Game::operator bool() const
 	{
-		return _window.isOpen();
+		return isOpen();
 	}
 
 	int32_t Game::play()
@@ -181,83 +125,203 @@ namespace aita
 		const auto handleClose = std::bind(&Game::onClose, this, std::placeholders::_1);
 		const auto handleKeypress = std::bind(&Game::onKeyPressed, this, std::placeholders::_1);
 
-		_player.reset();
+		_episode.reset();
+		_timestep.restart();
+		publish();
 
-		// The score is inversely proportional to the time taken to finish the game
-		// Higher score equals less time taken to make the jump
-		int32_t score = Configuration::MaxScore;
-		std::cout << _player << std::endl;
+		// In lockstep the first frame is the answer to a reset command
+		if (!_settings.lockstep)
+		{
+			report();
+		}
 
-		while (_window.isOpen() && score)
+		while (isOpen())
 		{
-			_window.handleEvents(handleClose, handleKeypress);
+			// Wait before reading the keys, so they are fresh for the frames they control
+			uint16_t frames = _settings.lockstep ? 0 : _timestep.due();
+
+			// A jump no frame has consumed yet carries over to the next update
+			_controls = { .jump = _controls.jump };
+
+			if (!_settings.headless)
+			{
+				_window.handleEvents(handleClose, handleKeypress);
+			}
 
-			onMove();
+			if (_settings.lockstep)
+			{
+				ActionRecord action;
+
+				if (!receive(action))
+				{
+					close();
+					break;
+				}
+
+				if (action.command == Command::Reset)
+				{
+					// An episode cut short restarts in this very frame, only a finished one leaves play() for main()
+					_episode.reset();
+					publish();
+					report();
+					continue;
+				}
+
+				_controls = action.controls;
+				frames = (action.command == Command::Query) ? 0 : action.frames;
+			}
+			else if (!_settings.headless)
+			{
+				onMove();
+			}
 
-			_player.update();
+			Result result = Result::None;
 
-			draw(score);
+			for (uint16_t i = 0; i < frames && result == Result::None; ++i)
+			{
+				result = _episode.advance(_controls);
+				++_frame;
+
+				// A key press lasts a single frame, however many frames this update covers
+				_controls.jump = false;
+
+				if (result == Result::None && !_settings.lockstep &&
+					(_settings.telemetry == Telemetry::Frame ||
+					_episode.physics().isMoving(_episode.body()) ||
+					_episode.score() % Configuration::FramesPerSecond == 0))
+				{
+					report();
+				}
+			}
 
-			if (_player.bottomRight().x >= Config.WindowWidth &&
-				_player.bottomRight().y >= Config.WindowHeight)
+			publish();
+
+			if (result != Result::None)
 			{
 				break;
 			}
 
-			if (_player.isMoving() || score % Configuration::FramesPerSecond == 0)
+			// In lockstep every command is answered, whether the player moved or not
+			if (_settings.lockstep || _queried->exchange(false))
 			{
-				std::cout << _player << std::endl;
+				report();
 			}
-
-			--score;
 		}
 
-		std::cout << _player << std::endl;
-		return _window.isOpen() ? score : 0;
+		report();
+		return isOpen() && _episode.result() == Result::Won ? _episode.score() : 0;
 	}
 
-	void Game::onClose(const sf::Event::Closed& closed)
+	bool Game::isOpen() const
+	{
+		return _settings.headless ? !_closed : _window.isOpen();
+	}
+
+	void Game::close()
 	{
+		_closed = true;
+		stopRendering();
 		_window.close();
 	}
 
+	void Game::onClose(const sf::Event::Closed& closed)
+	{
+		close();
+	}
+
 	void Game::onKeyPressed(const sf::Event::KeyPressed& keyPressed)
 	{
 		if (keyPressed.scancode == sf::Keyboard::Scancode::Escape)
 		{
-			_window.close();
+			close();
 		}
 		if (keyPressed.scancode == sf::Keyboard::Scancode::Space)
 		{
-			_player.jump();
+			_controls.jump = true;
 		}
 	}
 
 	void Game::onMove()
 	{
-		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right))
+		_controls.right = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right);
+		_controls.left = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left);
+		_controls.up = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Up);
+		_controls.down = sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Down);
+	}
+
+	bool Game::receive(ActionRecord& action)
+	{
+		std::array<char, ActionRecord::Size> buffer;
+
+		if (!std::cin.read(buffer.data(), buffer.size()))
+		{
+			return false; // aitaRL has gone away
+		}
+
+		action = ActionRecord::decode(buffer);
+
+		if (action.command != Command::Advance && action.command != Command::Reset && action.command != Command::Query)
 		{
-			_player.move({ Config.MoveVelocity, 0.0f });
+			throw std::runtime_error(std::format("Unknown command: {}", static_cast<int>(action.command)));
 		}
 
-		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left))
+		return true;
+	}
+
+	void Game::listen()
+	{
+		// The thread blocks in std::cin until aitaRL goes away, so it cannot be joined
+		std::thread([queried = _queried]()
+		{
+			std::array<char, ActionRecord::Size> buffer;
+
+			while (std::cin.read(buffer.data(), buffer.size()))
+			{
+				if (ActionRecord::decode(buffer).command == Command::Query)
+				{
+					queried->store(true);
+				}
+			}
+		}).detach();
+	}
+
+	void Game::publish()
+	{
+		if (!_renderer.joinable())
 		{
-			_player.move({ -Config.MoveVelocity, 0.0f });
+			return;
 		}
 
-		if (Config.Gravity > 0.0f)
+		Snapshot& snapshot = _snapshots.back();
+		snapshot.body = _episode.body();
+		snapshot.score = _episode.score();
+		_snapshots.publish();
+	}
+
+	void Game::render()
+	{
+		if (!_window.setActive(true))
 		{
+			std::println(std::cerr, "Failed to activate the window in the render thread");
 			return;
 		}
 
-		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Up))
+		while (_snapshots.acquire())
 		{
-			_player.move({ 0.0f, -Config.MoveVelocity });
+			const Snapshot& snapshot = _snapshots.front();
+			_player.update(snapshot.body);
+			draw(snapshot.score);
 		}
 
-		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Down))
+		_window.setActive(false);
+	}
+
+	void Game::stopRendering()
+	{
+		if (_renderer.joinable())
 		{
-			_player.move({ 0.0f, Config.MoveVelocity });
+			_snapshots.close();
+			_renderer.join();
 		}
 	}
 
@@ -280,12 +344,38 @@ namespace aita
 		_window.display();
 	}
 
-	std::ostream& operator << (std::ostream& os, const Player& player)
+	void Game::report()
+	{
+		if (_settings.protocol == Protocol::Text && !_ring)
+		{
+			std::cout << _episode.body() << std::endl;
+			return;
+		}
+
+		// A closed window ends the episode as lost
+		const Result result = isOpen() ? _episode.result() : Result::Lost;
+		const StateRecord record = StateRecord::capture(_frame, _episode.body(), result);
+
+		if (_ring)
+		{
+			// A full ring means nobody is reading, the frame number tells the reader what was dropped
+			_ring->push(record);
+			return;
+		}
+
+		std::array<char, StateRecord::Size> buffer;
+		record.encode(buffer);
+
+		std::cout.write(buffer.data(), buffer.size());
+		std::cout.flush();
+	}
+
+	std::ostream& operator << (std::ostream& os, const Body& body)
 	{
-		const auto pos = player.position();
+		const auto& pos = body.position;
 		os << pos.x << ' ' << pos.y;
 
-		const auto vel = player.velocity();
+		const auto& vel = body.velocity;
 		os << ' ' << vel.x << ' ' << vel.y;
 
 		return os;
@@ -1,86 +1,98 @@
 #pragma once
 
+#include "../Core/Protocol.hpp"
+#include "../Core/SharedRing.hpp"
+#include "../Core/Simulation.hpp"
+#include "TripleBuffer.hpp"
+
 namespace aita
 {
-	struct Configuration
+	class Player : public sf::Drawable
 	{
-		constexpr static uint32_t FramesPerSecond = 30;
-		constexpr static float DefaultWindowWidth = 800.0f;
-		constexpr static float DefaultWindowHeight = 600.0f;
-		constexpr static int32_t MaxScore = FramesPerSecond * 10;
-
-		const float WindowWidth;
-		const float WindowHeight;
-
-		const float FenceWidth;
-		const float FenceHeight;
-		const float FenceHalf;
-		const float FenceX;
-		const float FenceY;
-		const float FenceLeft;
-		const float FenceMiddle;
-		const float FenceRight;
-
-		float Gravity;
-		const float JumpVelocity;
-
-		float Friction;
-		const float MoveVelocity;
+	public:
+		Player(const Physics& physics);
 
-		const float HitPenaltyHorizontal;
-		const float HitPenaltyVertical;
+		void update(const Body& body);
+		void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
 
-		Configuration(float width, float height);
+	private:
+		sf::CircleShape _shape;
 	};
 
-	class Player : public sf::Drawable
+	// Turns elapsed wall time into whole frames of simulation, speed times faster than real time.
+	// The physics only ever advances in whole frames, so the trajectory does not depend on the speed.
+	class FixedTimestep
 	{
 	public:
-		const float Radius;
-		const float Diameter;
-		const float MinimumX;
-		const float MaximumX;
-		const float MinimumY;
-		const float MaximumY;
+		constexpr static uint16_t MaxFramesPerUpdate = Configuration::MaxScore;
 
-		Player(const Configuration& config);
+		FixedTimestep(float speed); // Zero is unlimited, one frame per update without waiting
 
-		void reset();
-		void jump();
-		void move(sf::Vector2f direction);
-		void update();
-		sf::Vector2f bottomRight() const;
-		void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
-
-		sf::Vector2f position() const;
-		sf::Vector2f velocity() const;
-		bool isMoving() const;
+		void restart();
+		uint16_t due(); // Waits for at least one frame to be due
 
 	private:
-		const aita::Configuration& _config;
-		sf::Vector2f _position;
-		sf::Vector2f _velocity;
-		sf::CircleShape _shape;
+		using Clock = std::chrono::steady_clock;
+
+		const Clock::duration _step;
+		Clock::time_point _previous;
+		Clock::duration _accumulated = Clock::duration::zero();
+	};
+
+	struct Settings
+	{
+		Protocol protocol = Protocol::Text;
+		std::string sharedMemory; // When set, the state records go to this shared memory ring instead of stdout
+		bool lockstep = false; // Advance only when an action record arrives on stdin, without a frame rate limit
+		bool headless = false; // No window and no rendering, only the state output. Paced by the speed like any other run
+		float speed = 1.0f; // Simulated time per wall time, zero runs the simulation as fast as possible
+		Telemetry telemetry = Telemetry::Changes; // Ignored in lockstep, where every command is answered
+	};
+
+	// What the render thread needs to draw a frame
+	struct Snapshot
+	{
+		Body body;
+		int32_t score = 0;
 	};
 
 	class Game
 	{
 	public:
 		Configuration Config;
-		Game(float width, float height);
+		Game(float width, float height, const Settings& settings = {});
+		~Game();
 		operator bool() const;
 		int32_t play();
 
 	private:
+		bool isOpen() const;
+		void close();
 		void onClose(const sf::Event::Closed& closed);
 		void onKeyPressed(const sf::Event::KeyPressed& keyPressed);
 		void onMove();
+		bool receive(ActionRecord& action);
+		void listen();
+		void publish();
+		void render();
+		void stopRendering();
 		void draw(int32_t score);
-
+		void report();
+
+		const Settings _settings;
+		std::unique_ptr<SharedRing> _ring;
+		uint64_t _frame = 0;
+		bool _closed = false;
+		std::shared_ptr<std::atomic<bool>> _queried = std::make_shared<std::atomic<bool>>(false);
+		FixedTimestep _timestep;
+		Episode _episode;
+		Controls _controls;
 		Player _player;
 		sf::RenderWindow _window;
 		sf::RectangleShape _fence;
+		TripleBuffer<Snapshot> _snapshots;
+		std::jthread _renderer;
 	};
 
-	std::ostream& operator << (std::ostream&, const Player&);
+	std::ostream& operator << (std::ostream&, const Body&);
 }
\ No newline at end of file
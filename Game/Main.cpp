@@ -18,7 +18,10 @@ namespace aita::snd
 			_beep(static_cast<uint32_t>(note), NoteDuration);
 		}
 #endif
-		std::this_thread::sleep_for(SleepDuration);
+		if (!NoSound)
+		{
+			std::this_thread::sleep_for(SleepDuration);
+		}
 	}
 
 	void win()
@@ -29,7 +32,10 @@ namespace aita::snd
 			_beep(static_cast<uint32_t>(note), NoteDuration);
 		}
 #endif
-		std::this_thread::sleep_for(SleepDuration);
+		if (!NoSound)
+		{
+			std::this_thread::sleep_for(SleepDuration);
+		}
 	}
 }
 
@@ -46,6 +52,12 @@ int main(int argc, char** argv)
 		printf("\t--height=<value>\tSet the window height (default: %.1f)\n", aita::Configuration::DefaultWindowHeight);
 		puts("\t--loop\t\t\tRun the game in a loop");
 		puts("\t--no-sound\t\tDisable sounds");
+		puts("\t--protocol=<value>\tState output format: text or binary (default: text)");
+		puts("\t--shm=<name>\t\tWrite binary state records to this shared memory ring instead of stdout");
+		puts("\t--lockstep\t\tAdvance only on action records read from stdin, answering each with a binary state record");
+		puts("\t--headless\t\tRun without a window, keys only arrive through --lockstep");
+		puts("\t--speed=<value>\t\tSimulation speed multiplier or unlimited (default: 1, unlimited with --headless)");
+		puts("\t--telemetry=<value>\tReport the state on changes, every frame or also on query commands from stdin (default: changes)");
 		return 0;
 	}
 
@@ -53,12 +65,57 @@ int main(int argc, char** argv)
 	const float windowHeight = arguments.get<float>("--height", aita::Configuration::DefaultWindowHeight);
 	aita::snd::NoSound = arguments.contains("--no-sound");
 
-	aita::Game game(windowWidth, windowHeight);
+	aita::Settings settings;
+	settings.protocol = aita::parseProtocol(arguments.get("--protocol", "text"));
+	settings.sharedMemory = arguments.get("--shm", "");
+	settings.lockstep = arguments.contains("--lockstep");
+	settings.headless = arguments.contains("--headless");
+	settings.telemetry = aita::parseTelemetry(arguments.get("--telemetry", "changes"));
+
+	// Nobody watches a headless game, it runs as fast as it can unless told otherwise
+	const std::string speed = arguments.get("--speed", settings.headless ? "unlimited" : "1");
+	settings.speed = (speed == "unlimited") ? 0.0f : std::stof(speed);
+
+	if (settings.speed < 0.0f)
+	{
+		std::println(std::cerr, "The speed cannot be negative");
+		return 1;
+	}
+
+	if (settings.lockstep)
+	{
+		settings.protocol = aita::Protocol::Binary;
+	}
+
+#ifdef WIN32
+	if (settings.lockstep || settings.telemetry == aita::Telemetry::Query)
+	{
+		// Action records arrive on stdin
+		_setmode(_fileno(stdin), _O_BINARY);
+	}
+#endif
+
+	const bool textOutput = settings.protocol == aita::Protocol::Text;
+
+	if (!textOutput)
+	{
+		// Nothing but state records may end up in the output
+		sf::err().rdbuf(nullptr);
+#ifdef WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+
+	aita::Game game(windowWidth, windowHeight, settings);
 
 	if (arguments.contains("--no-gravity"))
 	{
 		game.Config.Gravity = 0.0f;
-		std::println("Gravity disabled");
+
+		if (textOutput)
+		{
+			std::println("Gravity disabled");
+		}
 	}
 	
 	std::cout << std::setprecision(2) << std::fixed;
@@ -69,12 +126,20 @@ int main(int argc, char** argv)
 		
 		if (score)
 		{
-			std::println("won");
+			if (textOutput)
+			{
+				std::println("won");
+			}
+
 			aita::snd::win();
 		}
 		else
 		{
-			std::println("lost");
+			if (textOutput)
+			{
+				std::println("lost");
+			}
+
 			aita::snd::lose();
 		}
 
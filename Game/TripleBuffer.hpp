@@ -0,0 +1,61 @@
+#pragma once
+
+namespace aita
+{
+	// Hands the latest value from one writer thread to one reader thread without locks.
+	// The writer fills back() and publishes it, the reader waits for the newest value and reads front().
+	// Neither side ever waits for the other to finish with a slot, values the reader is too slow for are skipped.
+	template <typename T>
+	class TripleBuffer
+	{
+	public:
+		T& back()
+		{
+			return _slots[_back];
+		}
+
+		void publish()
+		{
+			_back = _middle.exchange(_back | Fresh, std::memory_order_acq_rel) & IndexMask;
+			_middle.notify_one();
+		}
+
+		// Blocks until a value newer than front() is published. Returns false once the buffer is closed.
+		bool acquire()
+		{
+			uint8_t middle = _middle.load(std::memory_order_acquire);
+
+			while (!(middle & Fresh))
+			{
+				_middle.wait(middle, std::memory_order_acquire);
+				middle = _middle.load(std::memory_order_acquire);
+			}
+
+			_front = _middle.exchange(_front, std::memory_order_acq_rel) & IndexMask;
+			return !_closed.load();
+		}
+
+		const T& front() const
+		{
+			return _slots[_front];
+		}
+
+		// Wakes the reader up for good
+		void close()
+		{
+			_closed.store(true);
+			_middle.fetch_or(Fresh, std::memory_order_acq_rel);
+			_middle.notify_one();
+		}
+
+	private:
+		constexpr static uint8_t IndexMask = 0x3;
+		constexpr static uint8_t Fresh = 0x4;
+
+		std::array<T, 3> _slots = {};
+		std::atomic<uint8_t> _middle = 1;
+		std::atomic<bool> _closed = false;
+		uint8_t _back = 0;
+		uint8_t _front = 2;
+	};
+}
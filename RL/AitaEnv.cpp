@@ -62,6 +62,21 @@ namespace aita
 		}
 	}
 
+	void GameState::decode(const StateRecord& record)
+	{
+		if (record.result == Result::None && result != Result::None)
+		{
+			return; // A reset is pending
+		}
+
+		posX = record.position.x;
+		posY = record.position.y;
+		velX = record.velocity.x;
+		velY = record.velocity.y;
+		result = record.result;
+		frame = record.frame;
+	}
+
 	float GameState::calculateStepReward(const GameState& current, const GameState& next, float actions)
 	{
 		float stepReward = -1.0f;
@@ -107,5 +122,10 @@ namespace aita
 		batchSize = arguments.get<uint32_t>("--batch_size", DefaultBatchSize);
 		gamma = arguments.get<float>("--gamma", DefaultGamma);
 		learningRate = arguments.get<double>("--learning_rate", DefaultLearningRate);
+		replayRatio = arguments.get<float>("--replay_ratio", DefaultReplayRatio);
+		publishInterval = std::max<uint32_t>(arguments.get<uint32_t>("--publish_interval", DefaultPublishInterval), 1);
+		prioritized = arguments.contains("--prioritized");
+		priorityAlpha = arguments.get<float>("--priority_alpha", DefaultPriorityAlpha);
+		priorityBeta = std::clamp(arguments.get<float>("--priority_beta", DefaultPriorityBeta), 0.0f, 1.0f);
 	}
 }
\ No newline at end of file
@@ -1,18 +1,13 @@
 #pragma once
 
 #include "../Common/Arguments.hpp"
+#include "../Core/Protocol.hpp"
+#include "../Core/Simulation.hpp"
 
 namespace aita
 {
 	using namespace std::chrono_literals;
 
-	enum class Result : uint8_t
-	{
-		None = 0,
-		Lost,
-		Won
-	};
-
 	constexpr std::chrono::seconds DefaultEpisodeDuration = 10s;
 	constexpr std::chrono::seconds DefaultEpisodeTimeout = DefaultEpisodeDuration + 1s;
 
@@ -26,6 +21,7 @@ namespace aita
 	constexpr std::chrono::milliseconds MinKeyPressDuration = 100ms;
 	constexpr std::chrono::milliseconds MaxKeyPressDuration = DefaultEpisodeDuration / 2;
 	constexpr std::chrono::milliseconds KeyPressResolution = 50ms;
+	constexpr std::chrono::milliseconds PipelineLead = KeyPressResolution; // How long before an action ends the next one is decided
 
 	constexpr int32_t MaxEpisodeSteps = 600;
 	constexpr float ProgressWeight = 1000.0f;
@@ -48,9 +44,11 @@ namespace aita
 		float velX = 0.0f;
 		float velY = 0.0f;
 		Result result = Result::None;
+		uint64_t frame = 0;
 
 		void reset();
 		void parse(std::string_view line);
+		void decode(const StateRecord& record);
 
 		static float calculateStepReward(const GameState& current, const GameState& next, float actions);
 		static float calculateEpisodeReward(const GameState& state, int32_t steps);
@@ -69,12 +67,21 @@ namespace aita
 	constexpr uint32_t DefaultBatchSize = 512;
 	constexpr float DefaultGamma = 0.99f;
 	constexpr float DefaultLearningRate = 0.00005f;
+	constexpr float DefaultReplayRatio = 1.0f;
+	constexpr uint32_t DefaultPublishInterval = 100;
+	constexpr uint64_t DefaultBenchmarkBatches = 1000;
+	constexpr float DefaultPriorityAlpha = 0.6f;
+	constexpr float DefaultPriorityBeta = 0.4f;
+	constexpr uint64_t PriorityBetaSteps = 100000; // Gradient steps until the importance sampling is fully corrected
+	constexpr float PriorityEpsilon = 1e-5f; // Keeps transitions without a TD error sampleable
 
 	inline std::uniform_real_distribution<float> FloatDist(0.0f, 1.0f);
 	inline std::uniform_int_distribution<int64_t> ActionDist(0, DQNActions - 1);
 
 	constexpr size_t SmaWindowSize = 100;
 
+	inline std::atomic<bool> KeepRunning = true;
+
 	class HyperParameters
 	{
 	public:
@@ -86,6 +93,11 @@ namespace aita
 		uint32_t batchSize = DefaultBatchSize;
 		float gamma = DefaultGamma;
 		float learningRate = DefaultLearningRate;
+		float replayRatio = DefaultReplayRatio; // Gradient steps per environment step
+		uint32_t publishInterval = DefaultPublishInterval; // Gradient steps between the weights handed to the actor
+		bool prioritized = false; // Sample by TD error instead of by reward stratum
+		float priorityAlpha = DefaultPriorityAlpha; // How much the TD error shapes the sampling, 0 is uniform
+		float priorityBeta = DefaultPriorityBeta; // Importance sampling correction at the start, annealed to 1
 
 		void parse(const Arguments&);
 	};
@@ -127,7 +139,10 @@ struct std::formatter<aita::HyperParameters>
 			"Epsilon decay: {}\n"
 			"Batch size: {}\n"
 			"Gamma: {}\n"
-			"Learning rate: {}\n",
+			"Learning rate: {}\n"
+			"Replay ratio: {}\n"
+			"Publish interval: {}\n"
+			"Prioritized replay: {} (alpha: {}, beta: {})\n",
 			hp.timeout.count(),
 			hp.replayBufferSize,
 			hp.epsilonStart,
@@ -135,6 +150,11 @@ struct std::formatter<aita::HyperParameters>
 			hp.epsilonDecay,
 			hp.batchSize,
 			hp.gamma,
-			hp.learningRate);
+			hp.learningRate,
+			hp.replayRatio,
+			hp.publishInterval,
+			hp.prioritized,
+			hp.priorityAlpha,
+			hp.priorityBeta);
 	}
 };
\ No newline at end of file
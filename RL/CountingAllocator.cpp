@@ -0,0 +1,48 @@
+#include "CountingAllocator.hpp"
+
+namespace aita
+{
+	CountingAllocator& CountingAllocator::install()
+	{
+		static CountingAllocator allocator(c10::GetCPUAllocator());
+		c10::SetCPUAllocator(&allocator);
+		return allocator;
+	}
+
+	CountingAllocator::CountingAllocator(c10::Allocator* allocator) :
+		_allocator(allocator)
+	{
+	}
+
+	c10::DataPtr CountingAllocator::allocate(size_t bytes)
+	{
+		_allocations.fetch_add(1, std::memory_order_relaxed);
+		_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		return _allocator->allocate(bytes);
+	}
+
+	c10::DeleterFnPtr CountingAllocator::raw_deleter() const
+	{
+		return _allocator->raw_deleter();
+	}
+
+	void CountingAllocator::copy_data(void* destination, const void* source, size_t count) const
+	{
+		_allocator->copy_data(destination, source, count);
+	}
+
+	bool CountingAllocator::is_simple_data_ptr(const c10::DataPtr& pointer) const
+	{
+		return _allocator->is_simple_data_ptr(pointer);
+	}
+
+	uint64_t CountingAllocator::allocations() const
+	{
+		return _allocations.load(std::memory_order_relaxed);
+	}
+
+	uint64_t CountingAllocator::bytes() const
+	{
+		return _bytes.load(std::memory_order_relaxed);
+	}
+}
\ No newline at end of file
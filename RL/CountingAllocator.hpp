@@ -0,0 +1,31 @@
+#pragma once
+
+namespace aita
+{
+	// Wraps the CPU allocator of libtorch and counts what goes through it, so that the heap allocations
+	// of a training step can be measured. Tensors allocated before install() are freed by their own allocator.
+	class CountingAllocator : public c10::Allocator
+	{
+	public:
+		// Replaces the CPU allocator for the rest of the process
+		static CountingAllocator& install();
+
+		CountingAllocator(const CountingAllocator&) = delete;
+		CountingAllocator& operator = (const CountingAllocator&) = delete;
+
+		c10::DataPtr allocate(size_t bytes) override;
+		c10::DeleterFnPtr raw_deleter() const override;
+		void copy_data(void* destination, const void* source, size_t count) const override;
+		bool is_simple_data_ptr(const c10::DataPtr& pointer) const override;
+
+		uint64_t allocations() const;
+		uint64_t bytes() const;
+
+	private:
+		explicit CountingAllocator(c10::Allocator* allocator);
+
+		c10::Allocator* const _allocator;
+		std::atomic<uint64_t> _allocations = 0;
+		std::atomic<uint64_t> _bytes = 0;
+	};
+}
\ No newline at end of file
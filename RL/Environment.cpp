@@ -0,0 +1,659 @@
+#include "Environment.hpp"
+#include "Logger.hpp"
+
+namespace aita
+{
+#ifdef WIN32
+	constexpr char GameWindowTitle[] = "Aita on matalin - The Fence Jump Game";
+
+	void ensureForegroundWindow()
+	{
+		HWND window = nullptr;
+
+		while (!window)
+		{
+			LOGI("Waiting for the game window to appear...");
+			Sleep(250);
+			window = FindWindowA(NULL, GameWindowTitle);
+		}
+
+		LOGI("Window found!");
+
+		if (!SetForegroundWindow(window))
+		{
+			LOGW("Failed to set foreground window.");
+		}
+	}
+#endif
+
+	constexpr int MaxRestartAttempts = 3;
+
+	std::string sharedRingName()
+	{
+		static std::atomic<uint32_t> counter = 0;
+#ifdef WIN32
+		return std::format("/aita-{}-{}", GetCurrentProcessId(), counter++);
+#else
+		return std::format("/aita-{}-{}", getpid(), counter++);
+#endif
+	}
+
+	std::vector<std::string> gameArguments(const GameOptions& options, const SharedRing* ring)
+	{
+		// The shared memory ring carries binary records, keep stdout quiet as well
+		const bool binary = ring || options.protocol == Protocol::Binary;
+
+		std::vector<std::string> arguments =
+		{
+			std::format("--width={}", WindowWidth),
+			std::format("--height={}", WindowHeight),
+			std::format("--protocol={}", binary ? "binary" : "text"),
+			std::format("--telemetry={}", telemetryName(options.telemetry)),
+			"--no-sound",
+			"--loop"
+		};
+
+		if (ring)
+		{
+			arguments.emplace_back(std::format("--shm={}", ring->name()));
+		}
+
+		return arguments;
+	}
+
+	std::chrono::milliseconds toKeyPressDuration(float timing)
+	{
+		using FloatMs = std::chrono::duration<float, std::milli>;
+		const FloatMs range = MaxKeyPressDuration - MinKeyPressDuration;
+
+		return MinKeyPressDuration + std::chrono::duration_cast<std::chrono::milliseconds>(range * timing);
+	}
+
+	std::vector<Controls> toFrameControls(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings)
+	{
+		using FloatMs = std::chrono::duration<float, std::milli>;
+		constexpr FloatMs frameDuration(1000.0f / Configuration::FramesPerSecond);
+
+		std::array<FloatMs, DQNKeys> pressTimes = {};
+		std::array<FloatMs, DQNKeys> releaseTimes = {};
+		FloatMs endTime = MinKeyPressDuration;
+
+		for (size_t i = 0; i < DQNKeys; ++i)
+		{
+			if (actions.test(i))
+			{
+				pressTimes[i] = toKeyPressDuration(timings[i * 2]);
+				releaseTimes[i] = pressTimes[i] + toKeyPressDuration(timings[i * 2 + 1]);
+				endTime = std::max(endTime, releaseTimes[i]);
+			}
+		}
+
+		std::vector<Controls> frames;
+		std::bitset<DQNKeys> previouslyHeld;
+
+		for (FloatMs now(0); now < endTime; now += frameDuration)
+		{
+			std::bitset<DQNKeys> held;
+
+			for (size_t i = 0; i < DQNKeys; ++i)
+			{
+				held[i] = actions.test(i) && pressTimes[i] <= now && now < releaseTimes[i];
+			}
+
+			const auto left = static_cast<size_t>(Key::Left);
+			const auto right = static_cast<size_t>(Key::Right);
+			const auto jump = static_cast<size_t>(Key::Jump);
+
+			Controls& controls = frames.emplace_back();
+			controls.left = held.test(left);
+			controls.right = held.test(right);
+			controls.jump = held.test(jump) && !previouslyHeld.test(jump); // The game jumps on key press, not while held
+
+			previouslyHeld = held;
+		}
+
+		return frames;
+	}
+
+	GameState Environment::reset()
+	{
+		_state = restart();
+		_ticks = 0;
+		return _state;
+	}
+
+	StepResult Environment::step(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings)
+	{
+		const GameState current = _state;
+
+		try
+		{
+			_state = execute(actions, timings);
+		}
+		catch (const GameInterrupted& ex)
+		{
+			LOGW("Episode interrupted after {} ticks: {}", _ticks, ex.what());
+			return { current, 0.0f, true, true };
+		}
+
+		++_ticks;
+
+		const bool done = (_state.result != Result::None);
+
+		const float reward = done ?
+			GameState::calculateEpisodeReward(_state, _ticks) :
+			GameState::calculateStepReward(current, _state, static_cast<float>(actions.count()));
+
+		return { _state, reward, done };
+	}
+
+	int32_t Environment::ticks() const
+	{
+		return _ticks;
+	}
+
+	ProcessEnvironment::ProcessEnvironment(const std::filesystem::path& gamePath, const GameOptions& options) :
+		_options(options),
+		_ring(options.sharedMemory ? std::make_unique<SharedRing>(sharedRingName(), true) : nullptr),
+		_pool(gamePath, gameArguments(options, _ring.get()), 1)
+	{
+#ifdef WIN32
+		ensureForegroundWindow();
+#endif
+		_spawned = _pool.process(0).started();
+
+		const auto parse = std::bind(&ProcessEnvironment::parseGameState, this, std::placeholders::_1);
+
+		// Text comes in lines, binary records are reassembled from the raw chunks
+		if (_options.protocol == Protocol::Text && !_ring)
+		{
+			_pool.process(0).redirectLines(parse);
+		}
+		else
+		{
+			_pool.process(0).redirect(parse);
+		}
+
+		if (_ring)
+		{
+			_ringThread = std::jthread([this](std::stop_token token)
+			{
+				consumeRing(token);
+			});
+		}
+	}
+
+	ProcessEnvironment::~ProcessEnvironment()
+	{
+		if (_ringThread.joinable())
+		{
+			_ringThread.request_stop();
+			_ringThread.join();
+
+			LOGI("Shared memory latency | {} | Dropped: {}", _ringLatency, _ring->dropped());
+		}
+
+		if (_options.pipelined)
+		{
+			LOGI("Action gap | {}", _actionGap);
+		}
+	}
+
+	GameState ProcessEnvironment::restart()
+	{
+		// The keys of an episode that ended mid-action are released
+		_keyboard.reset();
+		_previous.reset();
+		_actionEnd.reset();
+
+		if (!_pool.healthy(0))
+		{
+			respawn();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_writerMutex);
+			_latest.reset();
+
+			if (_nextEpisode.has_value())
+			{
+				// The game started the next episode before it was asked for
+				_latest = _nextEpisode.value();
+				_nextEpisode.reset();
+				_state.publish(_latest);
+				return _latest;
+			}
+
+			_state.publish(_latest);
+		}
+
+		GameState state;
+
+		for (int attempt = 1; KeepRunning && !observeState(state);)
+		{
+			if (_pool.healthy(0))
+			{
+				LOGW("Still waiting for the episode to start.");
+				continue;
+			}
+
+			if (attempt++ == MaxRestartAttempts)
+			{
+				throw std::runtime_error("The game process keeps exiting before the episode starts");
+			}
+
+			respawn();
+		}
+
+		return state;
+	}
+
+	GameState ProcessEnvironment::execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings)
+	{
+		const auto now = std::chrono::steady_clock::now();
+
+		// Pipelined, the action was decided while the previous one was held and starts right when it ends
+		const auto start = _actionEnd.has_value() ? std::max(now, _actionEnd.value()) : now;
+
+		if (_actionEnd.has_value())
+		{
+			_actionGap.record(now - _actionEnd.value());
+		}
+
+		auto keyboard = std::make_unique<Keyboard>();
+		auto maxEndTime = start;
+		bool keysPressed = false;
+
+		for (size_t i = 0; i < DQNKeys; ++i)
+		{
+			if (actions.test(i))
+			{
+				keysPressed = true;
+
+				const auto delayTime = toKeyPressDuration(timings[i * 2]);
+				const auto durationTime = toKeyPressDuration(timings[i * 2 + 1]);
+
+				const auto endTime = start + delayTime + durationTime;
+
+				*keyboard << KeyPress(keyFromIndex(i), delayTime, delayTime + durationTime);
+
+				if (endTime > maxEndTime)
+				{
+					maxEndTime = endTime;
+				}
+			}
+		}
+
+		if (keysPressed)
+		{
+			keyboard->sendKeys(start);
+		}
+		else
+		{
+			maxEndTime = start + MinKeyPressDuration;
+		}
+
+		// Pipelined, the next action is decided on the state a lead before this one ends, but never before it starts
+		const auto observeTime = _options.pipelined ? std::max(maxEndTime - PipelineLead, start) : maxEndTime;
+
+		GameState state;
+
+		// Wake up for every new state until it is time to observe, the episode may end before that
+		for (uint32_t sequence = _state.read(state);
+			KeepRunning && state.result == Result::None && _state.wait(sequence, observeTime);)
+		{
+			sequence = _state.read(state);
+		}
+
+		if (_options.pipelined)
+		{
+			// The keys stay held after this returns, the state is the latest one the game has reported
+			_previous = std::exchange(_keyboard, std::move(keyboard));
+			_actionEnd = maxEndTime;
+
+			if (state.result == Result::None && !_pool.healthy(0))
+			{
+				throw GameInterrupted("The game process exited");
+			}
+
+			return state;
+		}
+
+		// The keys have been released, wait for the game to report where the player ended up
+		if (state.result == Result::None && !observeState(state) && !_pool.healthy(0))
+		{
+			throw GameInterrupted("The game process exited");
+		}
+
+		return state;
+	}
+
+	void ProcessEnvironment::parseGameState(std::string_view processOutput)
+	{
+		if (_options.protocol == Protocol::Binary || _ring)
+		{
+			// The pipe belongs to the current process, so its records are never older than it
+			const auto now = std::chrono::steady_clock::now();
+
+			_recordReader.feed(processOutput, [this, now](std::span<const char, StateRecord::Size> data)
+			{
+				applyRecord(StateRecord::decode(data), now);
+			});
+
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_writerMutex);
+
+		try
+		{
+			if (_latest.result != Result::None)
+			{
+				// The lines of the next episode, the latest is kept until restart() asks for it
+				GameState next;
+				next.parse(processOutput);
+
+				if (next.result == Result::None && !processOutput.empty())
+				{
+					_nextEpisode = next;
+				}
+
+				return;
+			}
+
+			_latest.parse(processOutput);
+		}
+		catch (const std::exception& e)
+		{
+			LOGE("Failed to parse game state from process output: {}. Exception {}", processOutput, e.what());
+			return;
+		}
+
+		_state.publish(_latest);
+	}
+
+	void ProcessEnvironment::applyRecord(const StateRecord& record, std::chrono::steady_clock::time_point sent)
+	{
+		std::lock_guard<std::mutex> lock(_writerMutex);
+
+		// Left in the ring by a process that has been replaced since, its frames are from another count
+		if (sent < _spawned)
+		{
+			return;
+		}
+
+		// The final record of an episode may repeat the frame number of the one before it
+		if (record.frame < _latest.frame)
+		{
+			LOGW("Discarding stale frame {}, already at frame {}", record.frame, _latest.frame);
+			return;
+		}
+
+		if (record.frame > _latest.frame + 1)
+		{
+			LOGD("Frames {} to {} were not reported", _latest.frame + 1, record.frame - 1);
+		}
+
+		if (_latest.result != Result::None && record.result == Result::None)
+		{
+			// A frame of the next episode, the latest is kept until restart() asks for it
+			GameState next;
+			next.decode(record);
+			_nextEpisode = next;
+			return;
+		}
+
+		_latest.decode(record);
+		_state.publish(_latest);
+	}
+
+	void ProcessEnvironment::consumeRing(std::stop_token token)
+	{
+		StateRecord record;
+		std::chrono::steady_clock::time_point pushed;
+
+		while (!token.stop_requested())
+		{
+			if (!_ring->wait(std::chrono::milliseconds(100)))
+			{
+				continue;
+			}
+
+			while (_ring->pop(record, pushed))
+			{
+				_ringLatency.record(std::chrono::steady_clock::now() - pushed);
+				applyRecord(record, pushed);
+			}
+		}
+	}
+
+	bool ProcessEnvironment::observeState(GameState& state)
+	{
+		const uint32_t sequence = _state.sequence();
+
+		LOGD("Observing...");
+
+		if (_options.telemetry == Telemetry::Query)
+		{
+			// The answer comes within a frame, even when the player is standing still
+			std::array<char, ActionRecord::Size> buffer;
+			ActionRecord::query().encode(buffer);
+			_pool.process(0).write({ buffer.data(), buffer.size() });
+		}
+
+		if (!_state.wait(sequence, std::chrono::steady_clock::now() + DefaultEpisodeTimeout))
+		{
+			LOGW("Timeout waiting for game state.");
+			return false;
+		}
+
+		if (!KeepRunning)
+		{
+			return false;
+		}
+
+		_state.read(state);
+		return true;
+	}
+
+	void ProcessEnvironment::respawn()
+	{
+		// The old process stops reporting before restart() returns, the new one has not started to
+		Process& process = _pool.restart(0);
+
+		{
+			std::lock_guard<std::mutex> lock(_writerMutex);
+			_recordReader = {};
+			_spawned = process.started();
+
+			// The new process counts its frames from zero
+			_latest.reset();
+			_latest.frame = 0;
+			_nextEpisode.reset();
+			_state.publish(_latest);
+		}
+
+#ifdef WIN32
+		ensureForegroundWindow();
+#endif
+		const auto parse = std::bind(&ProcessEnvironment::parseGameState, this, std::placeholders::_1);
+
+		if (_options.protocol == Protocol::Text && !_ring)
+		{
+			process.redirectLines(parse);
+		}
+		else
+		{
+			process.redirect(parse);
+		}
+	}
+
+	std::vector<std::string> lockstepArguments(bool headless)
+	{
+		std::vector<std::string> arguments =
+		{
+			std::format("--width={}", WindowWidth),
+			std::format("--height={}", WindowHeight),
+			"--lockstep",
+			"--no-sound",
+			"--loop"
+		};
+
+		if (headless)
+		{
+			arguments.emplace_back("--headless");
+		}
+
+		return arguments;
+	}
+
+	LockstepEnvironment::LockstepEnvironment(ProcessPool& pool, size_t index) :
+		_pool(pool),
+		_index(index)
+	{
+	}
+
+	GameState LockstepEnvironment::restart()
+	{
+		for (int attempt = 1;; ++attempt)
+		{
+			if (_interrupted || !_pool.healthy(_index))
+			{
+				// Whatever the old process left unread belongs to an episode that is gone
+				_pool.restart(_index);
+				_recordReader = {};
+				_pending.clear();
+				_interrupted = false;
+			}
+
+			try
+			{
+				_latest = command(ActionRecord::reset());
+				return toGameState(_latest);
+			}
+			catch (const GameInterrupted& ex)
+			{
+				if (attempt == MaxRestartAttempts)
+				{
+					throw std::runtime_error(std::format("Game process {} keeps failing: {}", _index, ex.what()));
+				}
+
+				LOGW("Game process {} failed to start an episode: {}", _index, ex.what());
+			}
+		}
+	}
+
+	GameState LockstepEnvironment::execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings)
+	{
+		const std::vector<Controls> frames = toFrameControls(actions, timings);
+
+		// Frames with the same keys held are sent as one command
+		for (size_t first = 0; first < frames.size() && _latest.result == Result::None;)
+		{
+			size_t last = first + 1;
+
+			while (last < frames.size() && frames[last] == frames[first])
+			{
+				++last;
+			}
+
+			_latest = command(ActionRecord::advance(frames[first], static_cast<uint16_t>(last - first)));
+			first = last;
+		}
+
+		return toGameState(_latest);
+	}
+
+	StateRecord LockstepEnvironment::command(const ActionRecord& action)
+	{
+		std::array<char, ActionRecord::Size> buffer;
+		action.encode(buffer);
+
+		try
+		{
+			_pool.process(_index).write({ buffer.data(), buffer.size() });
+			return receive();
+		}
+		catch (const std::exception& ex)
+		{
+			_interrupted = true;
+			throw GameInterrupted(std::format("Game process {} stopped responding: {}", _index, ex.what()));
+		}
+	}
+
+	StateRecord LockstepEnvironment::receive()
+	{
+		while (_pending.empty())
+		{
+			Process& process = _pool.process(_index);
+
+			// A hung game would block the read forever, restart() respawns it after this
+			if (!process.waitForOutput(DefaultEpisodeTimeout))
+			{
+				throw GameInterrupted(std::format("No state within {}", DefaultEpisodeTimeout));
+			}
+
+			std::array<char, 0x1000> buffer;
+			const std::optional<size_t> count = process.read(buffer);
+
+			if (!count.has_value())
+			{
+				throw std::runtime_error("The game process closed its output");
+			}
+
+			_recordReader.feed(std::string_view(buffer.data(), count.value()), [this](std::span<const char, StateRecord::Size> data)
+			{
+				_pending.push_back(StateRecord::decode(data));
+			});
+		}
+
+		const StateRecord record = _pending.front();
+		_pending.pop_front();
+		return record;
+	}
+
+	GameState LockstepEnvironment::toGameState(const StateRecord& record)
+	{
+		GameState state;
+		state.decode(record);
+		return state;
+	}
+
+	SimulatedEnvironment::SimulatedEnvironment() :
+		_config(static_cast<float>(WindowWidth), static_cast<float>(WindowHeight)),
+		_episode(_config)
+	{
+	}
+
+	GameState SimulatedEnvironment::restart()
+	{
+		_episode.reset();
+		return observe();
+	}
+
+	GameState SimulatedEnvironment::execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings)
+	{
+		for (const Controls& controls : toFrameControls(actions, timings))
+		{
+			if (_episode.advance(controls) != Result::None)
+			{
+				break;
+			}
+		}
+
+		return observe();
+	}
+
+	GameState SimulatedEnvironment::observe() const
+	{
+		const Body& body = _episode.body();
+
+		GameState state;
+		state.posX = body.position.x;
+		state.posY = body.position.y;
+		state.velX = body.velocity.x;
+		state.velY = body.velocity.y;
+		state.result = _episode.result();
+		return state;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "AitaEnv.hpp"
+#include "Histogram.hpp"
+#include "Keyboard.hpp"
+#include "ProcessPool.hpp"
+#include "RecordReader.hpp"
+#include "StateChannel.hpp"
+#include "../Core/SharedRing.hpp"
+
+namespace aita
+{
+	struct StepResult
+	{
+		GameState state;
+		float reward = 0.0f;
+		bool done = false;
+		bool interrupted = false; // The game process died during the step, the episode ends without a real outcome
+	};
+
+	// Thrown by an environment whose game process died, the next reset() starts over in a fresh process
+	class GameInterrupted : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	// Gym-style interface: reset() starts an episode, step() executes one action synchronously
+	class Environment
+	{
+	public:
+		virtual ~Environment() = default;
+
+		GameState reset();
+		StepResult step(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings);
+		int32_t ticks() const;
+
+	protected:
+		virtual GameState restart() = 0;
+		virtual GameState execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings) = 0;
+
+	private:
+		GameState _state;
+		int32_t _ticks = 0;
+	};
+
+	struct GameOptions
+	{
+		Protocol protocol = Protocol::Text;
+		bool sharedMemory = false; // Receive the state through a shared memory ring instead of stdout
+		Telemetry telemetry = Telemetry::Changes; // With Query every observation asks the game for its state
+		bool pipelined = false; // Observe before the keys are released and start the next action right when they are
+	};
+
+	// Runs the game executable and presses the keys through the OS
+	class ProcessEnvironment : public Environment
+	{
+	public:
+		ProcessEnvironment(const std::filesystem::path& gamePath, const GameOptions& options);
+		~ProcessEnvironment() override;
+
+	protected:
+		GameState restart() override;
+		GameState execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings) override;
+
+	private:
+		void parseGameState(std::string_view processOutput);
+		void applyRecord(const StateRecord& record, std::chrono::steady_clock::time_point sent);
+		void consumeRing(std::stop_token token);
+		bool observeState(GameState& state);
+		void respawn();
+
+		const GameOptions _options;
+		RecordReader<StateRecord::Size> _recordReader;
+		std::mutex _writerMutex; // Serializes the output, ring and reset writers, never taken by a reader
+		GameState _latest; // The writers' copy, guarded by the writer mutex
+		std::chrono::steady_clock::time_point _spawned; // Of the current process, guarded by the writer mutex
+		std::optional<GameState> _nextEpisode; // The latest state of an episode the game started before restart()
+		StateChannel<GameState> _state;
+		std::unique_ptr<SharedRing> _ring;
+		Histogram _ringLatency;
+		ProcessPool _pool; // A single process, the keyboard cannot drive more
+		std::jthread _ringThread;
+
+		// Pipelined, step() returns while its keys are still held and the next action is queued behind them
+		std::unique_ptr<Keyboard> _keyboard;
+		std::unique_ptr<Keyboard> _previous;
+		std::optional<std::chrono::steady_clock::time_point> _actionEnd;
+		Histogram _actionGap; // From the end of an action to the start of the next one
+	};
+
+	std::vector<std::string> lockstepArguments(bool headless);
+
+	// Drives one process of the pool in lockstep: every step is sent to its stdin as action records
+	// and the game advances exactly the frames they ask for, as fast as it can
+	class LockstepEnvironment : public Environment
+	{
+	public:
+		LockstepEnvironment(ProcessPool& pool, size_t index);
+
+	protected:
+		GameState restart() override;
+		GameState execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings) override;
+
+	private:
+		StateRecord command(const ActionRecord& action);
+		StateRecord receive();
+		static GameState toGameState(const StateRecord& record);
+
+		ProcessPool& _pool;
+		const size_t _index;
+		bool _interrupted = false;
+		RecordReader<StateRecord::Size> _recordReader;
+		std::deque<StateRecord> _pending;
+		StateRecord _latest;
+	};
+
+	// Runs the game physics in-process, one frame per simulated 1/30th of a second
+	class SimulatedEnvironment : public Environment
+	{
+	public:
+		SimulatedEnvironment();
+
+	protected:
+		GameState restart() override;
+		GameState execute(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings) override;
+
+	private:
+		GameState observe() const;
+
+		Configuration _config;
+		Episode _episode;
+	};
+
+	std::chrono::milliseconds toKeyPressDuration(float timing);
+
+	// Expands timed key presses into the controls of each frame at the game's frame rate
+	std::vector<Controls> toFrameControls(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings);
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+namespace aita
+{
+	// Counts durations in power-of-two nanosecond buckets, cheap enough to record every event
+	class Histogram
+	{
+	public:
+		constexpr static size_t Buckets = 40;
+
+		void record(std::chrono::nanoseconds duration)
+		{
+			const uint64_t value = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+			const size_t bucket = std::min<size_t>(std::bit_width(value), Buckets - 1);
+
+			++_buckets[bucket];
+			++_count;
+			_sum += value;
+			_min = std::min(_min, value);
+			_max = std::max(_max, value);
+		}
+
+		uint64_t count() const
+		{
+			return _count;
+		}
+
+		double minimumMicroseconds() const
+		{
+			return _count ? static_cast<double>(_min) / 1000.0 : 0.0;
+		}
+
+		double meanMicroseconds() const
+		{
+			return _count ? static_cast<double>(_sum) / static_cast<double>(_count) / 1000.0 : 0.0;
+		}
+
+		double maximumMicroseconds() const
+		{
+			return static_cast<double>(_max) / 1000.0;
+		}
+
+		// Upper bound of the bucket the percentile falls into
+		double percentileMicroseconds(double percentile) const
+		{
+			const uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(_count)));
+			uint64_t seen = 0;
+
+			for (size_t i = 0; i < Buckets; ++i)
+			{
+				seen += _buckets[i];
+
+				if (seen >= rank && seen > 0)
+				{
+					return static_cast<double>(uint64_t(1) << i) / 1000.0;
+				}
+			}
+
+			return maximumMicroseconds();
+		}
+
+	private:
+		std::array<uint64_t, Buckets> _buckets = {};
+		uint64_t _count = 0;
+		uint64_t _sum = 0;
+		uint64_t _min = std::numeric_limits<uint64_t>::max();
+		uint64_t _max = 0;
+	};
+
+	// Records how long the enclosing scope took
+	class ScopedLatency
+	{
+	public:
+		explicit ScopedLatency(Histogram& histogram) :
+			_histogram(histogram),
+			_start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~ScopedLatency()
+		{
+			_histogram.record(std::chrono::steady_clock::now() - _start);
+		}
+
+		ScopedLatency(const ScopedLatency&) = delete;
+		ScopedLatency& operator = (const ScopedLatency&) = delete;
+
+	private:
+		Histogram& _histogram;
+		const std::chrono::steady_clock::time_point _start;
+	};
+}
+
+template <>
+struct std::formatter<aita::Histogram>
+{
+	constexpr auto parse(std::format_parse_context& ctx)
+	{
+		return ctx.begin();
+	}
+
+	auto format(const aita::Histogram& h, std::format_context& ctx) const
+	{
+		return std::format_to(ctx.out(), "n: {} | min: {:.1f}us | mean: {:.1f}us | p50: <{:.1f}us | p99: <{:.1f}us | max: {:.1f}us",
+			h.count(),
+			h.minimumMicroseconds(),
+			h.meanMicroseconds(),
+			h.percentileMicroseconds(50.0),
+			h.percentileMicroseconds(99.0),
+			h.maximumMicroseconds());
+	}
+};
\ No newline at end of file
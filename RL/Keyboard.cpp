@@ -6,6 +6,9 @@ namespace aita
 {
 	constexpr char KeyChars[] = { 'L', 'R', 'J' };
 
+	// The condition variable wakes up this long before a deadline, the rest is slept precisely
+	constexpr std::chrono::microseconds PreciseSleepMargin(2000);
+
 	Key keyFromIndex(int64_t index)
 	{
 		switch (index)
@@ -56,27 +59,6 @@ namespace aita
 	class VirtualInputDevice
 	{
 	public:
-		static VirtualInputDevice& instance()
-		{
-			static VirtualInputDevice instance;
-			return instance;
-		}
-
-		void sendEvent(uint16_t type, uint16_t code, int32_t val) const
-		{
-			struct input_event ie = {};
-			ie.type = type;
-			ie.code = code;
-			ie.value = val;
-			gettimeofday(&ie.time, nullptr);
-
-			if (write(_deviceDescriptor, &ie, sizeof(ie)) < 0)
-			{
-				LOGE("Failed to send event: type={}, code={}", type, code);
-			}
-		}
-
-	private:
 		VirtualInputDevice() :
 			_deviceDescriptor(open("/dev/uinput", O_WRONLY | O_NONBLOCK))
 		{
@@ -116,6 +98,13 @@ namespace aita
 		VirtualInputDevice(VirtualInputDevice&&) = delete;
 		VirtualInputDevice& operator = (VirtualInputDevice&&) = delete;
 
+		// The kernel timestamps the events, one write delivers them all at once. False with errno set if it failed.
+		bool sendEvents(std::span<const input_event> events) const
+		{
+			return write(_deviceDescriptor, events.data(), events.size_bytes()) >= 0;
+		}
+
+	private:
 		PosixHandle _deviceDescriptor;
 	};
 #endif
@@ -127,69 +116,352 @@ namespace aita
 	{
 	}
 
-	void KeyPress::execute(std::stop_source stop_source, std::chrono::steady_clock::time_point startTime)
+	bool KeyScheduler::isLater(const Event& a, const Event& b)
+	{
+		if (a.deadline != b.deadline)
+		{
+			return a.deadline > b.deadline;
+		}
+
+		return a.press > b.press;
+	}
+
+	KeyScheduler& KeyScheduler::instance()
+	{
+		static KeyScheduler instance;
+		return instance;
+	}
+
+	KeyScheduler::KeyScheduler()
+	{
+#ifdef WIN32
+		_timer.reset(CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+
+		if (!_timer.isValid())
+		{
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "Failed to create a high resolution timer");
+		}
+#else
+		_device = std::make_unique<VirtualInputDevice>();
+#endif
+		_thread = std::jthread([this](std::stop_token token)
+		{
+			run(token);
+		});
+
+		_created = true;
+	}
+
+	KeyScheduler::~KeyScheduler()
+	{
+		// Only releases the keys, the logger may already be gone during static destruction
+		if (_thread.joinable())
+		{
+			_quiet = true;
+			_thread.request_stop();
+			_thread.join();
+		}
+	}
+
+	void KeyScheduler::shutdown()
+	{
+		if (_created)
+		{
+			instance().stop();
+		}
+	}
+
+	void KeyScheduler::stop()
 	{
-		std::stop_token token = stop_source.get_token();
+		if (!_thread.joinable())
+		{
+			return;
+		}
+
+		_thread.request_stop();
+		_thread.join();
+
+		LOGI("Key event lateness | {}", _lateness);
+	}
+
+	uint64_t KeyScheduler::schedule(std::span<const KeyPress> presses, std::chrono::steady_clock::time_point start)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const uint64_t timeline = _nextTimeline++;
+
+		for (const KeyPress& press : presses)
+		{
+			const uint64_t id = _nextPress++;
+
+			_events.push_back({ start + press.from, timeline, id, press.key, true });
+			std::ranges::push_heap(_events, isLater);
 
-		const auto offset = std::chrono::steady_clock::now() - startTime;
-		const auto delay = from - offset;
-		const auto duration = to - from;
+			_events.push_back({ start + press.to, timeline, id, press.key, false });
+			std::ranges::push_heap(_events, isLater);
+		}
 
-		const auto wait = [&](std::chrono::nanoseconds waitTime)
+		if (!presses.empty())
 		{
-			if (waitTime <= std::chrono::milliseconds(1))
+			_remaining[timeline] = presses.size() * 2;
+		}
+
+		++_revision;
+		_condition.notify_one();
+		return timeline;
+	}
+
+	void KeyScheduler::cancel(uint64_t timeline)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		withdraw(timeline);
+	}
+
+	void KeyScheduler::wait(uint64_t timeline)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_completed.wait(lock, [&]
+		{
+			return _stopped || !_remaining.contains(timeline);
+		});
+	}
+
+	void KeyScheduler::run(std::stop_token token)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		while (!token.stop_requested())
+		{
+			const uint64_t revision = _revision;
+
+			if (_events.empty())
 			{
-				return true;
+				_condition.wait(lock, token, [&] { return _revision != revision; });
+				continue;
 			}
 
-			std::mutex mtx;
-			std::unique_lock<std::mutex> lock(mtx);
-			std::condition_variable_any cv;
+			const auto deadline = _events.front().deadline;
+			const auto now = std::chrono::steady_clock::now();
 
-			cv.wait_for(lock, token, waitTime, []
+			if (deadline - now > PreciseSleepMargin)
 			{
-				return false;
-			});
+				// Coarse, but new events can interrupt it
+				_condition.wait_until(lock, token, deadline - PreciseSleepMargin, [&] { return _revision != revision; });
+				continue;
+			}
 
-			return !token.stop_requested();
-		};
+			if (now < deadline)
+			{
+				lock.unlock();
+				sleepUntil(deadline);
+				lock.lock();
+			}
+
+			// Everything that is due goes out together
+			_due.clear();
+
+			for (const auto due = std::chrono::steady_clock::now(); !_events.empty() && _events.front().deadline <= due;)
+			{
+				std::ranges::pop_heap(_events, isLater);
+				_due.push_back(_events.back());
+				_events.pop_back();
+			}
+
+			if (_due.empty())
+			{
+				continue;
+			}
+
+			lock.unlock();
+			fire(_due);
+			lock.lock();
+
+			for (const Event& event : _due)
+			{
+				complete(event.timeline, 1);
+			}
+		}
+
+		// Nobody is left to release the keys that are held. Not fired, this may run during static destruction.
+		withdraw(std::nullopt);
+		send(_events);
+
+		_events.clear();
+		_remaining.clear();
+		_stopped = true;
+		_completed.notify_all();
+	}
 
+	void KeyScheduler::sleepUntil(std::chrono::steady_clock::time_point deadline)
+	{
 #ifdef WIN32
-	 	const BYTE virtualKey = toVirtualKey(key);
-		const UINT scan = static_cast<BYTE>(MapVirtualKeyW(virtualKey, MAPVK_VK_TO_VSC));
+		const auto remaining = deadline - std::chrono::steady_clock::now();
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, 10000000>>>(remaining).count(); // Relative, in 100 ns
 
-		if (!wait(delay))
+		if (dueTime.QuadPart < 0 && SetWaitableTimerEx(_timer, &dueTime, 0, nullptr, nullptr, nullptr, 0))
 		{
-			return;
+			WaitForSingleObject(_timer, INFINITE);
 		}
-
-		keybd_event(virtualKey, scan, KeyDown | KeyExtended, 0);
-		wait(duration);
-		keybd_event(virtualKey, scan, KeyUp | KeyExtended, 0);
 #else
-		const uint16_t evdevCode = toEvdevCode(key);
+		// steady_clock is CLOCK_MONOTONIC, sleeping to an absolute deadline does not accumulate drift
+		const auto sinceEpoch = deadline.time_since_epoch();
+		const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch);
+
+		timespec absolute = {};
+		absolute.tv_sec = static_cast<time_t>(seconds.count());
+		absolute.tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch - seconds).count());
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &absolute, nullptr) == EINTR)
+		{
+		}
+#endif
+	}
 
-		if (!wait(delay))
+	void KeyScheduler::fire(std::span<const Event> events)
+	{
+		if (events.empty())
 		{
 			return;
 		}
 
-		const auto& device = VirtualInputDevice::instance();
+		if (!_quiet)
+		{
+			for (const Event& event : events)
+			{
+				LOGD("{} {}", KeyChars[static_cast<size_t>(event.key)], event.down ? "down" : "up");
+			}
+		}
 
-		device.sendEvent(EV_KEY, evdevCode, KeyDown);
-		device.sendEvent(EV_SYN, SYN_REPORT, 0);
+		if (!send(events) && !_quiet)
+		{
+			LOGE("Failed to send {} key events: {}", events.size(), std::strerror(errno));
+		}
 
-		wait(duration);
+		const auto fired = std::chrono::steady_clock::now();
 
-		device.sendEvent(EV_KEY, evdevCode, KeyUp);
-		device.sendEvent(EV_SYN, SYN_REPORT, 0);
+		for (const Event& event : events)
+		{
+			_lateness.record(fired - event.deadline);
+		}
+	}
+
+	bool KeyScheduler::send(std::span<const Event> events)
+	{
+		if (events.empty())
+		{
+			return true;
+		}
+
+		_inputs.clear();
+
+		for (const Event& event : events)
+		{
+#ifdef WIN32
+			const BYTE virtualKey = toVirtualKey(event.key);
+
+			INPUT& input = _inputs.emplace_back();
+			input.type = INPUT_KEYBOARD;
+			input.ki.wVk = virtualKey;
+			input.ki.wScan = static_cast<WORD>(MapVirtualKeyW(virtualKey, MAPVK_VK_TO_VSC));
+			input.ki.dwFlags = (event.down ? KeyDown : KeyUp) | KeyExtended;
+#else
+			input_event& input = _inputs.emplace_back();
+			input.type = EV_KEY;
+			input.code = toEvdevCode(event.key);
+			input.value = event.down ? KeyDown : KeyUp;
+#endif
+		}
+
+#ifdef WIN32
+		return SendInput(static_cast<UINT>(_inputs.size()), _inputs.data(), sizeof(INPUT)) == _inputs.size();
+#else
+		input_event& report = _inputs.emplace_back();
+		report.type = EV_SYN;
+		report.code = SYN_REPORT;
+		report.value = 0;
+
+		return _device->sendEvents(_inputs);
 #endif
-		LOGD("({}, {}, {}) executed", KeyChars[static_cast<size_t>(key)], from, to);
+	}
+
+	void KeyScheduler::withdraw(std::optional<uint64_t> timeline)
+	{
+		const auto selected = [&](const Event& event)
+		{
+			return !timeline.has_value() || event.timeline == timeline.value();
+		};
+
+		// A key press whose down event is still queued has not started
+		std::vector<uint64_t> unstarted;
+
+		for (const Event& event : _events)
+		{
+			if (selected(event) && event.down)
+			{
+				unstarted.push_back(event.press);
+			}
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		std::unordered_map<uint64_t, size_t> dropped;
+
+		std::erase_if(_events, [&](const Event& event)
+		{
+			if (!selected(event) || std::ranges::find(unstarted, event.press) == unstarted.end())
+			{
+				return false;
+			}
+
+			++dropped[event.timeline];
+			return true;
+		});
+
+		// The rest are releases of keys that are held, they fire right away
+		for (Event& event : _events)
+		{
+			if (selected(event))
+			{
+				event.deadline = now;
+			}
+		}
+
+		std::ranges::make_heap(_events, isLater);
+
+		for (const auto& [id, events] : dropped)
+		{
+			complete(id, events);
+		}
+
+		++_revision;
+		_condition.notify_one();
+	}
+
+	void KeyScheduler::complete(uint64_t timeline, size_t events)
+	{
+		const auto remaining = _remaining.find(timeline);
+
+		if (remaining == _remaining.end())
+		{
+			return;
+		}
+
+		remaining->second -= std::min(events, remaining->second);
+
+		if (remaining->second == 0)
+		{
+			_remaining.erase(remaining);
+			_completed.notify_all();
+		}
 	}
 
 	Keyboard::~Keyboard()
 	{
-		_stopSource.request_stop();
+		if (_timeline.has_value())
+		{
+			KeyScheduler& scheduler = KeyScheduler::instance();
+			scheduler.cancel(_timeline.value());
+			scheduler.wait(_timeline.value());
+		}
 	}
 
 	Keyboard& Keyboard::operator<<(KeyPress&& key)
@@ -198,12 +470,11 @@ namespace aita
 		return *this;
 	}
 
-	void Keyboard::sendKeys()
+	void Keyboard::sendKeys(std::chrono::steady_clock::time_point start)
 	{
 		std::string message;
-		auto startTime = std::chrono::steady_clock::now();
 
-		for (KeyPress& kp : _keys)
+		for (const KeyPress& kp : _keys)
 		{
 			if (!message.empty())
 			{
@@ -211,21 +482,18 @@ namespace aita
 			}
 
 			message += std::format("({}, {}, {})", KeyChars[static_cast<size_t>(kp.key)], kp.from, kp.to);
-
-			_threads.emplace_back(&KeyPress::execute, &kp, _stopSource, startTime);
 		}
 
 		LOGI("Executing: {}", message.empty() ? "None" : message);
+
+		_timeline = KeyScheduler::instance().schedule(_keys, start);
 	}
 
 	void Keyboard::wait()
 	{
-		for (std::jthread& thread : _threads)
+		if (_timeline.has_value())
 		{
-			if (thread.joinable())
-			{
-				thread.join();
-			}
+			KeyScheduler::instance().wait(_timeline.value());
 		}
 	}
-}
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "Handle.hpp"
+#include "Histogram.hpp"
+
 namespace aita
 {
 	enum class Key : uint8_t
@@ -15,24 +18,98 @@ namespace aita
 	{
 	public:
 		KeyPress(Key key, std::chrono::milliseconds from, std::chrono::milliseconds to);
-		void execute(std::stop_source stop_source, std::chrono::steady_clock::time_point startTime);
 
 		const Key key;
 		const std::chrono::milliseconds from;
 		const std::chrono::milliseconds to;
 	};
 
+#ifndef WIN32
+	class VirtualInputDevice;
+#endif
+
+	// One long-lived thread that owns the input device and fires every key down and up event at its deadline.
+	// A timeline is the set of key presses of one action, scheduled relative to a common start time.
+	// How late the events fire is kept in a histogram that shutdown() logs.
+	class KeyScheduler
+	{
+	public:
+		static KeyScheduler& instance();
+
+		// Releases the keys that are held, stops the thread and logs the lateness. Must be called while logging
+		// still works, on every way out of main(). Does nothing if no key was ever scheduled.
+		static void shutdown();
+
+		KeyScheduler(const KeyScheduler&) = delete;
+		KeyScheduler& operator = (const KeyScheduler&) = delete;
+		KeyScheduler(KeyScheduler&&) = delete;
+		KeyScheduler& operator = (KeyScheduler&&) = delete;
+
+		uint64_t schedule(std::span<const KeyPress> presses, std::chrono::steady_clock::time_point start);
+
+		// Drops the presses that have not started yet and releases the keys that are held right away
+		void cancel(uint64_t timeline);
+
+		// Blocks until every event of the timeline has fired
+		void wait(uint64_t timeline);
+
+	private:
+		struct Event
+		{
+			std::chrono::steady_clock::time_point deadline;
+			uint64_t timeline = 0;
+			uint64_t press = 0; // Pairs the down and up events of a key press
+			Key key = Key::Left;
+			bool down = false;
+		};
+
+		KeyScheduler();
+		~KeyScheduler();
+
+		static bool isLater(const Event& a, const Event& b);
+
+		void stop();
+		void run(std::stop_token token);
+		void sleepUntil(std::chrono::steady_clock::time_point deadline);
+		void fire(std::span<const Event> events);
+		bool send(std::span<const Event> events); // Without logging, false if the events could not be sent
+		void withdraw(std::optional<uint64_t> timeline);
+		void complete(uint64_t timeline, size_t events);
+
+#ifdef WIN32
+		WinHandle _timer;
+		std::vector<INPUT> _inputs;
+#else
+		std::unique_ptr<VirtualInputDevice> _device;
+		std::vector<input_event> _inputs;
+#endif
+		std::vector<Event> _due;
+		Histogram _lateness;
+		std::mutex _mutex;
+		std::condition_variable_any _condition;
+		std::condition_variable _completed;
+		std::vector<Event> _events; // A heap with the earliest deadline on top
+		std::unordered_map<uint64_t, size_t> _remaining; // Events left per timeline
+		uint64_t _revision = 0;
+		uint64_t _nextTimeline = 0;
+		uint64_t _nextPress = 0;
+		bool _stopped = false; // Nothing fires anymore, nobody waits for it
+		std::atomic<bool> _quiet = false; // Set by the destructor, the logger may already be gone
+		std::jthread _thread;
+
+		inline static std::atomic<bool> _created = false;
+	};
+
 	class Keyboard
 	{
 	public:
 		Keyboard() = default;
 		~Keyboard();
 		Keyboard& operator << (KeyPress&& key);
-		void sendKeys();
+		void sendKeys(std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now()); // The presses are relative to the start
 		void wait();
 	private:
 		std::vector<KeyPress> _keys;
-		std::stop_source _stopSource;
-		std::vector<std::jthread> _threads;
+		std::optional<uint64_t> _timeline;
 	};
 };
\ No newline at end of file
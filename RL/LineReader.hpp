@@ -0,0 +1,101 @@
+#pragma once
+
+namespace aita
+{
+	// Splits a byte stream into lines without allocating. Data is read straight into writable(),
+	// the lines handed out by commit() are views into the reader's own buffer, valid during the callback.
+	// A line split between two reads is carried over to the front of the buffer.
+	class LineReader
+	{
+	public:
+		constexpr static size_t Capacity = 0x10000;
+
+		std::span<char> writable()
+		{
+			if (_begin == _end)
+			{
+				_begin = 0;
+				_end = 0;
+			}
+			else if (_begin > 0)
+			{
+				std::memmove(_buffer.data(), _buffer.data() + _begin, _end - _begin);
+				_end -= _begin;
+				_begin = 0;
+			}
+
+			if (_end == Capacity)
+			{
+				// A line that does not fit cannot be framed, drop it
+				++_overflows;
+				_end = 0;
+			}
+
+			return std::span<char>(_buffer).subspan(_end);
+		}
+
+		template <typename F>
+		void commit(size_t count, F&& onLine)
+		{
+			const char* const data = _buffer.data();
+			const char* search = data + _end; // The carried part has no newline in it
+			const char* const end = search + count;
+			const char* lineStart = data + _begin;
+
+			_end += count;
+			_bytes += count;
+
+			while (const char* newline = static_cast<const char*>(std::memchr(search, '\n', static_cast<size_t>(end - search))))
+			{
+				std::string_view line(lineStart, static_cast<size_t>(newline - lineStart));
+
+				if (line.ends_with('\r'))
+				{
+					line.remove_suffix(1);
+				}
+
+				++_lines;
+				onLine(line);
+
+				lineStart = newline + 1;
+				search = lineStart;
+			}
+
+			_begin = static_cast<size_t>(lineStart - data);
+
+			if (_begin != _end)
+			{
+				++_carries;
+			}
+		}
+
+		uint64_t bytes() const
+		{
+			return _bytes;
+		}
+
+		uint64_t lines() const
+		{
+			return _lines;
+		}
+
+		uint64_t carries() const
+		{
+			return _carries;
+		}
+
+		uint64_t overflows() const
+		{
+			return _overflows;
+		}
+
+	private:
+		std::array<char, Capacity> _buffer = {};
+		size_t _begin = 0;
+		size_t _end = 0;
+		uint64_t _bytes = 0;
+		uint64_t _lines = 0;
+		uint64_t _carries = 0;
+		uint64_t _overflows = 0;
+	};
+}
@@ -1,62 +1,45 @@
 #include "AitaEnv.hpp"
+#include "CountingAllocator.hpp"
+#include "Environment.hpp"
+#include "Histogram.hpp"
+#include "VectorEnvironment.hpp"
 #include "Keyboard.hpp"
-#include "Process.hpp"
 #include "RL.hpp"
 #include "MultiRingBuffer.hpp"
 #include "Logger.hpp"
 
 namespace aita
 {
-#ifdef WIN32
-	void ensureForegroundWindow(std::wstring_view applicationTitle)
+	inline std::array<float, DQNStates> toArray(const GameState& state)
 	{
-		HWND window = nullptr;
-
-		while (!window)
-		{
-			LOGI("Waiting for the game window to appear...");
-			Sleep(250);
-			window = FindWindowW(NULL, L"Aita on matalin - The Fence Jump Game");
-		}
-
-		LOGI("Window found!");
-
-		if (!SetForegroundWindow(window))
+		return
 		{
-			LOGW("Failed to set foreground window.");
-		}
-	}
-#endif
-
-	std::mutex Mutex;
-	std::condition_variable Condition;
-	uint64_t Sequence = 0;
-	std::atomic<bool> KeepRunning = true;
-	GameState State;
-
-	inline torch::Tensor toTensor(const GameState& state)
-	{
-		return torch::tensor({
 			state.posX / static_cast<float>(WindowWidth),
 			state.posY / static_cast<float>(WindowHeight),
 			state.velX / VelocityScaleX,
 			state.velY / VelocityScaleY
-		});
+		};
 	}
 
-	inline std::array<float, DQNStates> toArray(const GameState& state)
+	inline torch::Tensor toTensor(std::span<const GameState> states)
 	{
-		return
+		torch::Tensor tensor = torch::empty(
+			{ static_cast<int64_t>(states.size()), static_cast<int64_t>(DQNStates) },
+			torch::kFloat32);
+
+		float* data = tensor.data_ptr<float>();
+
+		for (const GameState& state : states)
 		{
-			state.posX / static_cast<float>(WindowWidth),
-			state.posY / static_cast<float>(WindowHeight),
-			state.velX / VelocityScaleX,
-			state.velY / VelocityScaleY
-		};
+			const std::array<float, DQNStates> values = toArray(state);
+			data = std::copy(values.begin(), values.end(), data);
+		}
+
+		return tensor;
 	}
 
 	template <size_t S, size_t K, size_t T, size_t N>
-	void loadSession(bool trainingMode, MultiRingBuffer<Transition<S, K, T>, N>& replayBuffer, Checkpoint& checkpoint)
+	void loadSession(bool trainingMode, MultiRingBuffer<S, K, T, N>& replayBuffer, Checkpoint& checkpoint)
 	{
 		if (checkpoint.load())
 		{
@@ -85,7 +68,7 @@ namespace aita
 	}
 
 	template <size_t S, size_t K, size_t T, size_t N>
-	void saveSession(const MultiRingBuffer<Transition<S, K, T>, N>& replayBuffer, const Checkpoint& checkpoint)
+	void saveSession(const MultiRingBuffer<S, K, T, N>& replayBuffer, const Checkpoint& checkpoint)
 	{
 		if (checkpoint.save())
 		{
@@ -106,154 +89,128 @@ namespace aita
 		}
 	}
 
-	void parseGameState(std::string_view processOutput)
+	// Epsilon-greedy over a batch of q-values, returns the chosen actions and which of them were explored
+	std::pair<torch::Tensor, torch::Tensor> decideAction(float currentEpsilon, const torch::Tensor& qValues)
 	{
-		std::lock_guard<std::mutex> lock(Mutex);
+		const int64_t count = qValues.size(0);
+		const torch::Tensor isExploration = torch::rand({ count }) < currentEpsilon;
+		const torch::Tensor randomActions = torch::randint(static_cast<int64_t>(DQNActions), { count }, torch::kInt64);
 
-		try
-		{
-			State.parse(processOutput);
-		}
-		catch (const std::exception& e)
-		{
-			LOGE("Failed to parse game state from process output: {}. Exception {}", processOutput, e.what());
-			return;
-		}
-		
-		++Sequence;
-		Condition.notify_all();
+		return { torch::where(isExploration, randomActions, qValues.argmax(1)), isExploration };
 	}
 
-	bool observeState(GameState& state)
+	template <size_t S, size_t K, size_t T, size_t N>
+	struct OptimizationContext
 	{
-		std::unique_lock<std::mutex> lock(Mutex);
-		const uint64_t currentSequence = Sequence;
-
-		LOGD("Observing...");
-
-		if (!Condition.wait_for(lock, DefaultEpisodeTimeout, [&] { return Sequence != currentSequence; }))
+		OptimizationContext(
+			std::shared_ptr<DQN> network,
+			std::shared_ptr<DQN> targetNetwork,
+			std::shared_ptr<torch::optim::Optimizer> optimizer,
+			MultiRingBuffer<S, K, T, N>& memory,
+			typename MultiRingBuffer<S, K, T, N>::Batch& batch,
+			const HyperParameters& params) :
+			network(std::move(network)),
+			targetNetwork(std::move(targetNetwork)),
+			optimizer(std::move(optimizer)),
+			memory(memory),
+			batch(batch),
+			params(params),
+			keys(torch::arange(static_cast<int64_t>(K), torch::kInt64)),
+			pressed(torch::empty({ static_cast<int64_t>(params.batchSize), static_cast<int64_t>(K) }, torch::kInt64)),
+			mask(torch::empty({ static_cast<int64_t>(params.batchSize), static_cast<int64_t>(T) }, torch::kFloat32))
 		{
-			LOGW("Timeout waiting for game state.");
-			return false;
 		}
 
-		if (!KeepRunning)
-		{
-			return false;
-		}
+		std::shared_ptr<DQN> network;
+		std::shared_ptr<DQN> targetNetwork;
+		std::shared_ptr<torch::optim::Optimizer> optimizer;
+		MultiRingBuffer<S, K, T, N>& memory;
+		typename MultiRingBuffer<S, K, T, N>::Batch& batch;
+		const HyperParameters& params;
 
-		state = State;
-		return true;
-	}
+		// Reused by every step, like the batch itself
+		torch::Tensor keys; // [K], the bit of each key
+		torch::Tensor pressed; // [B, K]
+		torch::Tensor mask; // [B, T], the timings that are learned
 
-	std::pair<std::bitset<DQNKeys>, bool> decideAction(float currentEpsilon, const torch::Tensor& qValues)
+		uint64_t steps = 0; // Gradient steps taken
+	};
+
+	// Copies the weights of one network into another of the same shape
+	void copyParameters(const DQN& from, DQN& to)
 	{
-		const bool isExploration = random(FloatDist) < currentEpsilon;
+		torch::NoGradGuard noGrad;
+		const std::vector<torch::Tensor> source = from.parameters();
+		std::vector<torch::Tensor> target = to.parameters();
 
-		if (isExploration)
+		for (size_t i = 0; i < source.size(); ++i)
 		{
-			return { random(ActionDist), true };
+			target[i].copy_(source[i]);
 		}
-
-		return { qValues.argmax().item<int64_t>(), false };
 	}
 
-	GameState executeActionAndWait(std::bitset<DQNKeys> actions, const std::array<float, DQNTimings>& timings)
+	// Only the timings of the pressed keys are learned, each key has a from and a to timing.
+	// Turns the [B, 1] action indices of the batch into the [B, T] mask of the context without leaving libtorch.
+	template <size_t S, size_t K, size_t T, size_t N>
+	void timingMask(OptimizationContext<S, K, T, N>& ctx)
 	{
-		Keyboard keyboard;
-		auto maxEndTime = std::chrono::steady_clock::now();
-		bool keysPressed = false;
-
-		using FloatMs = std::chrono::duration<float, std::milli>;
-		const FloatMs range = MaxKeyPressDuration - MinKeyPressDuration;
+		static_assert(T == K * 2, "Every key has a from and a to timing");
 
-		for (size_t i = 0; i < DQNKeys; ++i)
-		{
-			if (actions.test(i))
-			{
-				keysPressed = true;
-
-				const float delayFloat = timings[i * 2];
-				const float durationFloat = timings[i * 2 + 1];
-
-				const auto delayTime = MinKeyPressDuration +
-					std::chrono::duration_cast<std::chrono::milliseconds>(range * delayFloat);
-
-				const auto durationTime = MinKeyPressDuration +
-					std::chrono::duration_cast<std::chrono::milliseconds>(range * durationFloat);
+		torch::bitwise_right_shift_out(ctx.pressed, ctx.batch.actions, ctx.keys);
+		ctx.pressed.bitwise_and_(1);
+		ctx.mask.view({ ctx.mask.size(0), static_cast<int64_t>(K), 2 }).copy_(ctx.pressed.unsqueeze(2));
+	}
 
-				const auto endTime = std::chrono::steady_clock::now() + delayTime + durationTime;
+	// The same mask built element by element, what the benchmark measures timingMask() against
+	template <size_t S, size_t K, size_t T, size_t N>
+	void timingMaskLoop(OptimizationContext<S, K, T, N>& ctx)
+	{
+		ctx.mask.zero_();
 
-				keyboard << KeyPress(keyFromIndex(i), delayTime, delayTime + durationTime);
+		for (int64_t i = 0; i < ctx.mask.size(0); ++i)
+		{
+			std::bitset<K> pressed(static_cast<uint64_t>(ctx.batch.actions[i][0].template item<int64_t>()));
 
-				if (endTime > maxEndTime)
+			for (size_t k = 0; k < K; ++k)
+			{
+				if (pressed.test(k))
 				{
-					maxEndTime = endTime;
+					ctx.mask[i][k * 2] = 1.0f;
+					ctx.mask[i][k * 2 + 1] = 1.0f;
 				}
 			}
 		}
-
-		if (keysPressed)
-		{
-			keyboard.sendKeys();
-		}
-		else
-		{
-			maxEndTime = std::chrono::steady_clock::now() + MinKeyPressDuration;
-		}
-
-		std::unique_lock<std::mutex> lock(Mutex);
-		Condition.wait_until(lock, maxEndTime, []
-		{
-			return !KeepRunning || State.result != Result::None;
-		});
-
-		return State;
 	}
 
-	template <size_t S, size_t K, size_t T, size_t N>
-	struct OptimizationContext
-	{
-		std::shared_ptr<DQN> network;
-		std::shared_ptr<DQN> targetNetwork;
-		std::shared_ptr<torch::optim::Optimizer> optimizer;
-		MultiRingBuffer<Transition<S, K, T>, N>& memory;
-		std::vector<Transition<S, K, T>>& batch;
-		const HyperParameters& params;
-	};
-
-	template <size_t S, size_t K, size_t T, size_t N>
-	void optimizeNetwork(OptimizationContext<S, K, T, N>& ctx)
+	// Returns false if the replay buffer cannot fill a batch yet
+	template <size_t S, size_t K, size_t T, size_t N, auto Mask = timingMask<S, K, T, N>>
+	bool optimizeNetwork(OptimizationContext<S, K, T, N>& ctx)
 	{
+		// The actor keeps storing transitions meanwhile
 		if (!ctx.memory.isReadyForBatch(ctx.params.batchSize))
 		{
-			return;
+			return false;
 		}
 
-		std::span<Transition<S, K, T>> batchSpan(ctx.batch);
-		ctx.memory.sampleStratifiedBatch(batchSpan);
-
-		const int64_t batchSize = ctx.params.batchSize;
-		torch::Tensor prevStateBatch = torch::empty({ batchSize, static_cast<int64_t>(S) }, torch::kFloat32);
-		torch::Tensor nextStateBatch = torch::empty({ batchSize, static_cast<int64_t>(S) }, torch::kFloat32);
-		torch::Tensor actionBatch = torch::empty({ batchSize, 1 }, torch::kInt64);
-		torch::Tensor rewardBatch = torch::empty({ batchSize }, torch::kFloat32);
-		torch::Tensor doneBatch = torch::empty({ batchSize }, torch::kBool);
-		torch::Tensor executedTimingsBatch = torch::empty({ batchSize, static_cast<int64_t>(T) }, torch::kFloat32);
-
-		for (size_t i = 0; i < batchSize; ++i)
+		if (ctx.memory.prioritized())
 		{
-			const Transition<S, K, T>& t = ctx.batch[i];
-
-			std::memcpy(prevStateBatch[i].data_ptr<float>(), t.state.data(), S * sizeof(float));
-			std::memcpy(nextStateBatch[i].data_ptr<float>(), t.nextState.data(), S * sizeof(float));
+			// The importance sampling correction grows to the full amount over the course of training
+			const float progress = std::min(static_cast<float>(ctx.steps) / static_cast<float>(PriorityBetaSteps), 1.0f);
+			ctx.memory.samplePrioritizedBatch(ctx.batch, std::lerp(ctx.params.priorityBeta, 1.0f, progress));
+		}
+		else
+		{
+			ctx.memory.sampleStratifiedBatch(ctx.batch);
+		}
 
-			actionBatch[i][0] = static_cast<int64_t>(t.action.to_ullong());
-			rewardBatch[i] = t.reward;
-			doneBatch[i] = t.done;
+		++ctx.steps;
 
-			std::memcpy(executedTimingsBatch[i].data_ptr<float>(), t.timings.data(), T * sizeof(float));
-		}
+		const torch::Tensor& prevStateBatch = ctx.batch.states;
+		const torch::Tensor& nextStateBatch = ctx.batch.nextStates;
+		const torch::Tensor& actionBatch = ctx.batch.actions;
+		const torch::Tensor& rewardBatch = ctx.batch.rewards;
+		const torch::Tensor& doneBatch = ctx.batch.dones;
+		const torch::Tensor& executedTimingsBatch = ctx.batch.timings;
 
 		auto [currentQValues, currentTimings] = ctx.network->forward(prevStateBatch);
 		torch::Tensor stateActionValues = currentQValues.gather(1, actionBatch).squeeze(1);
@@ -267,23 +224,29 @@ namespace aita
 		}
 
 		torch::Tensor expectedStateActionValues = rewardBatch + (ctx.params.gamma * nextStateValues);
-		torch::Tensor qLoss = torch::nn::functional::smooth_l1_loss(stateActionValues, expectedStateActionValues);
-		torch::Tensor mask = torch::zeros({ batchSize, static_cast<int64_t>(T) }, torch::kFloat32);
+		torch::Tensor qLoss = torch::nn::functional::smooth_l1_loss(
+			stateActionValues,
+			expectedStateActionValues,
+			torch::nn::functional::SmoothL1LossFuncOptions().reduction(torch::kNone)
+		);
 
-		for (size_t i = 0; i < batchSize; ++i)
+		// The weights are ones unless prioritized
+		qLoss = (qLoss * ctx.batch.weights).mean();
+
+		if (ctx.memory.prioritized())
 		{
-			std::bitset<K> actions(static_cast<uint64_t>(actionBatch[i][0].item<int64_t>()));
+			const torch::Tensor priorities = (expectedStateActionValues - stateActionValues.detach())
+				.abs_()
+				.add_(PriorityEpsilon)
+				.pow_(ctx.params.priorityAlpha)
+				.contiguous();
 
-			for (size_t k = 0; k < K; ++k)
-			{
-				if (actions.test(k))
-				{
-					mask[i][k * 2] = 1.0f;
-					mask[i][k * 2 + 1] = 1.0f;
-				}
-			}
+			ctx.memory.updatePriorities(ctx.batch, std::span<const float>(priorities.data_ptr<float>(), static_cast<size_t>(priorities.numel())));
 		}
 
+		Mask(ctx);
+		const torch::Tensor& mask = ctx.mask;
+
 		torch::Tensor timingLoss = torch::nn::functional::mse_loss(
 			currentTimings,
 			executedTimingsBatch,
@@ -296,7 +259,8 @@ namespace aita
 
 		torch::Tensor totalLoss = qLoss + timingLoss;
 
-		ctx.optimizer->zero_grad();
+		// Zeroing in place keeps the gradient buffers for the next step
+		ctx.optimizer->zero_grad(false);
 		totalLoss.backward();
 		torch::nn::utils::clip_grad_norm_(ctx.network->parameters(), 1.0);
 		ctx.optimizer->step();
@@ -308,11 +272,142 @@ namespace aita
 			auto targetParams = ctx.targetNetwork->parameters();
 			for (size_t i = 0; i < params.size(); ++i)
 			{
-				targetParams[i].copy_(tau * params[i] + (1.0f - tau) * targetParams[i]);
+				targetParams[i].lerp_(params[i], tau);
 			}
 		}
+
+		return true;
 	}
 
+	// Trains the network on its own thread, so acting never waits for a gradient step.
+	// The learner keeps to the replay ratio and never runs ahead of it. The actor acts with a copy
+	// of the weights that is published every few gradient steps.
+	template <size_t S, size_t K, size_t T, size_t N>
+	class Learner
+	{
+	public:
+		explicit Learner(OptimizationContext<S, K, T, N>& context) :
+			_context(context),
+			_published(static_cast<int64_t>(S), static_cast<int64_t>(1 << K), static_cast<int64_t>(T))
+		{
+			publish();
+
+			_thread = std::jthread([this](std::stop_token token)
+			{
+				run(token);
+			});
+		}
+
+		~Learner()
+		{
+			_thread.request_stop();
+			_thread.join();
+
+			LOGI("Learn | {} | Replay ratio: {:.3f}", _latency, replayRatio());
+		}
+
+		// The learner catches up with every environment step, up to the replay ratio
+		void stepped(size_t environmentSteps)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_environmentSteps += environmentSteps;
+			}
+
+			_condition.notify_one();
+		}
+
+		// Copies the latest published weights into the actor's network, if there are new ones
+		void refresh(DQN& actor)
+		{
+			const uint64_t version = _version.load();
+
+			if (version == _refreshed)
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(_publishMutex);
+			copyParameters(_published, actor);
+			_refreshed = version;
+		}
+
+		// Holds the learner between two gradient steps, so that a consistent checkpoint can be saved
+		std::unique_lock<std::mutex> pause()
+		{
+			return std::unique_lock<std::mutex>(_trainingMutex);
+		}
+
+	private:
+		void run(std::stop_token token)
+		{
+			uint64_t trained = 0;
+
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+
+					if (!_condition.wait(lock, token, [this] { return _gradientSteps < target(); }))
+					{
+						return;
+					}
+
+					// A step without enough experience counts too, or the learner would spin until there is
+					++_gradientSteps;
+				}
+
+				std::lock_guard<std::mutex> lock(_trainingMutex);
+				const auto start = std::chrono::steady_clock::now();
+
+				if (!optimizeNetwork(_context))
+				{
+					continue;
+				}
+
+				_latency.record(std::chrono::steady_clock::now() - start);
+
+				if (++trained % _context.params.publishInterval == 0)
+				{
+					publish();
+				}
+			}
+		}
+
+		void publish()
+		{
+			std::lock_guard<std::mutex> lock(_publishMutex);
+			copyParameters(*_context.network, _published);
+			_version.fetch_add(1);
+		}
+
+		uint64_t target() const
+		{
+			return static_cast<uint64_t>(static_cast<double>(_environmentSteps) * _context.params.replayRatio);
+		}
+
+		double replayRatio() const
+		{
+			return _environmentSteps ? static_cast<double>(_latency.count()) / static_cast<double>(_environmentSteps) : 0.0;
+		}
+
+		OptimizationContext<S, K, T, N>& _context;
+		Histogram _latency;
+
+		std::mutex _mutex;
+		std::condition_variable_any _condition;
+		uint64_t _environmentSteps = 0;
+		uint64_t _gradientSteps = 0;
+
+		std::mutex _trainingMutex;
+		std::mutex _publishMutex;
+		DQN _published;
+		std::atomic<uint64_t> _version = 0;
+		uint64_t _refreshed = 0;
+
+		std::jthread _thread;
+	};
+
 	float simpleMovingAverage(std::deque<float>& recentRewards, float newReward)
 	{
 		recentRewards.push_back(newReward);
@@ -326,7 +421,22 @@ namespace aita
 		return sum / static_cast<float>(recentRewards.size());
 	}
 
-	void run(bool trainingMode, Process& process, HyperParameters& hp)
+	// Where the time of each agent step goes. Learning runs on its own thread and logs its own latency.
+	struct StageLatencies
+	{
+		Histogram decide;
+		Histogram act; // Waiting for the environments
+		Histogram store;
+
+		void log() const
+		{
+			LOGI("Decide | {}", decide);
+			LOGI("Act    | {}", act);
+			LOGI("Store  | {}", store);
+		}
+	};
+
+	void run(bool trainingMode, VectorEnvironment& environments, HyperParameters& hp)
 	{
 		auto network = std::make_shared<DQN>(DQNStates, DQNActions, DQNTimings);
 		auto targetNetwork = std::make_shared<DQN>(DQNStates, DQNActions, DQNTimings);
@@ -347,7 +457,6 @@ namespace aita
 				torch::optim::AdamOptions(hp.learningRate));
 
 		float epsilon = trainingMode ? hp.epsilonStart : 0.00f;
-		int32_t tick = 0;
 		int64_t step = 0;
 		int64_t episode = 0;
 
@@ -362,10 +471,9 @@ namespace aita
 			}
 		};
 
-		MultiRingBuffer<Transition<DQNStates, DQNKeys, DQNTimings>, MultiRingBufferSize> replayBuffer(hp.replayBufferSize);
-		std::vector<Transition<DQNStates, DQNKeys, DQNTimings>> batch(hp.batchSize);
+		MultiRingBuffer<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize> replayBuffer(hp.replayBufferSize, hp.prioritized);
+		auto batch = replayBuffer.batch(hp.batchSize);
 		Checkpoint checkpoint("aita_dqn.pt", context);
-		GameState currentState;
 
 		OptimizationContext<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize> optContext{
 			network,
@@ -378,6 +486,17 @@ namespace aita
 
 		loadSession(trainingMode, replayBuffer, checkpoint);
 
+		// The actor decides with its own copy of the weights while the learner trains the network
+		DQN actor(DQNStates, DQNActions, DQNTimings);
+		copyParameters(*network, actor);
+
+		std::optional<Learner<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize>> learner;
+
+		if (trainingMode)
+		{
+			learner.emplace(optContext);
+		}
+
 		const auto start = std::chrono::steady_clock::now();
 		const auto maximumExecTime = start + hp.timeout;
 		const auto timeLeft = [&maximumExecTime]()->bool
@@ -386,62 +505,75 @@ namespace aita
 		};
 
 		std::deque<float> recentRewards;
+		int64_t finishedEpisodes = 0;
+		StageLatencies stages;
+
+		const size_t environmentCount = environments.size();
+		std::vector<GameState> currentStates(environmentCount);
+		std::vector<std::bitset<DQNKeys>> actions(environmentCount);
+		std::vector<std::array<float, DQNTimings>> executedTimings(environmentCount);
+
+		std::ranges::copy(environments.reset(), currentStates.begin());
 
 		while (KeepRunning && timeLeft())
 		{
-			if (!observeState(currentState))
 			{
-				continue;
+				ScopedLatency latency(stages.decide);
+				torch::NoGradGuard noGrad;
+
+				if (learner)
+				{
+					learner->refresh(actor);
+				}
+
+				const auto [qValues, timings] = actor.forward(toTensor(currentStates));
+				const auto [actionIndices, isExploration] = decideAction(epsilon, qValues);
+
+				constexpr int maxSteps = (MaxKeyPressDuration - MinKeyPressDuration) / KeyPressResolution;
+
+				// Explored actions get random timings, all timings are rounded to the key press resolution
+				torch::Tensor timingBatch = torch::where(isExploration.unsqueeze(1), torch::rand_like(timings), timings);
+				timingBatch = (torch::round(timingBatch * maxSteps) / static_cast<float>(maxSteps)).contiguous();
+
+				const auto actionAccessor = actionIndices.accessor<int64_t, 1>();
+				const float* timingData = timingBatch.data_ptr<float>();
+
+				for (size_t i = 0; i < environmentCount; ++i)
+				{
+					actions[i] = static_cast<uint64_t>(actionAccessor[static_cast<int64_t>(i)]);
+					std::copy_n(timingData + i * DQNTimings, DQNTimings, executedTimings[i].begin());
+				}
 			}
 
-			bool done = (currentState.result != Result::None);
-			float reward = 0.0f;
-			GameState nextState = currentState;
+			std::span<const StepResult> results;
 
-			if (done)
 			{
-				reward = GameState::calculateEpisodeReward(currentState, tick);
+				ScopedLatency latency(stages.act);
+				results = environments.step(actions, executedTimings);
 			}
-			else
-			{
-				const torch::Tensor stateTensor = toTensor(currentState);
-				const auto [qValues, timings] = network->forward(stateTensor);
-				const auto [actionBitmask, isExploration] = decideAction(epsilon, qValues);
 
-				std::array<float, DQNTimings> executedTimings;
+			const auto storeStart = std::chrono::steady_clock::now();
 
-				constexpr int maxSteps = (MaxKeyPressDuration - MinKeyPressDuration) / KeyPressResolution;
+			for (size_t i = 0; i < environmentCount; ++i)
+			{
+				const auto& [nextState, reward, done, interrupted] = results[i];
 
-				for (size_t i = 0; i < DQNKeys; ++i)
+				// The game crashed mid-step, there is no outcome to learn from and neither the step nor the episode counts
+				if (interrupted)
 				{
-					const size_t delayIndex = i * 2;
-					const size_t durationIndex = delayIndex + 1;
-
-					const float rawDelay = isExploration ? random(FloatDist) : timings[delayIndex].item<float>();
-					const float rawDuration = isExploration ? random(FloatDist) : timings[durationIndex].item<float>();
-
-					executedTimings[delayIndex] = std::round(rawDelay * maxSteps) / static_cast<float>(maxSteps);
-					executedTimings[durationIndex] = std::round(rawDuration * maxSteps) / static_cast<float>(maxSteps);
+					continue;
 				}
 
-				nextState = executeActionAndWait(actionBitmask, executedTimings);
-				done = (nextState.result != Result::None);
-
 				++step;
-				++tick;
-
-				reward = done ?
-					GameState::calculateEpisodeReward(nextState, tick) :
-					GameState::calculateStepReward(currentState, nextState, actionBitmask.count());
 
 				if (trainingMode)
 				{
 					if (reward < 0.0f)
 					{
 						replayBuffer.emplace<Ugly>(
-							toArray(currentState),
-							actionBitmask,
-							executedTimings,
+							toArray(currentStates[i]),
+							actions[i],
+							executedTimings[i],
 							reward,
 							toArray(nextState),
 							done);
@@ -449,9 +581,9 @@ namespace aita
 					else if (reward < GoalBonus)
 					{
 						replayBuffer.emplace<Bad>(
-							toArray(currentState),
-							actionBitmask,
-							executedTimings,
+							toArray(currentStates[i]),
+							actions[i],
+							executedTimings[i],
 							reward,
 							toArray(nextState),
 							done);
@@ -459,50 +591,51 @@ namespace aita
 					else
 					{
 						replayBuffer.emplace<Good>(
-							toArray(currentState),
-							actionBitmask,
-							executedTimings,
+							toArray(currentStates[i]),
+							actions[i],
+							executedTimings[i],
 							reward,
 							toArray(nextState),
 							done);
 					}
+				}
 
-					optimizeNetwork(optContext);
+				// Following every environment would flood the log, the first one is representative
+				if (i == 0)
+				{
+					LOGI("Step {} | X: {:.2f} | Y: {:.2f} | Reward: {:.2f}",
+						step,
+						nextState.posX,
+						nextState.posY,
+						reward);
 				}
-			}
 
-			LOGI("Step {} | X: {:.2f} | Y: {:.2f} | Reward: {:.2f}",
-				step,
-				nextState.posX,
-				nextState.posY,
-				reward);
+				if (!done)
+				{
+					continue;
+				}
 
-			if (done)
-			{
 				++episode;
+				++finishedEpisodes;
 
 				const auto now = std::chrono::steady_clock::now();
 				const auto remaining = std::max(std::chrono::seconds(0),
 					std::chrono::duration_cast<std::chrono::seconds>(maximumExecTime - now));
+				const double elapsedSeconds = std::chrono::duration<double>(now - start).count();
 
-				LOGI("Episode {} | Result: {} | Score: {:.2f} | Ticks: {} | Epsilon: {:.5f} | Buffers: {}/{}/{} | Time Left: {:%T}",
+				LOGI("Episode {} | Env: {} | Result: {} | Score: {:.2f} | Ticks: {} | Epsilon: {:.5f} | Buffers: {}/{}/{} | Episodes/s: {:.2f} | Time Left: {:%T}",
 					episode,
+					i,
 					(nextState.result == Result::Won ? "Won" : "Lost"),
 					reward,
-					tick,
+					environments.episodeTicks(i),
 					epsilon,
 					replayBuffer.count<Ugly>(),
 					replayBuffer.count<Bad>(),
 					replayBuffer.count<Good>(),
+					static_cast<double>(finishedEpisodes) / elapsedSeconds,
 					remaining);
 
-				tick = 0;
-
-				{
-					std::lock_guard<std::mutex> lock(Mutex);
-					State.reset();
-				}
-
 				if (trainingMode)
 				{
 					if (replayBuffer.isReadyForBatch(hp.batchSize))
@@ -512,18 +645,137 @@ namespace aita
 
 					if (episode % 10 == 0)
 					{
+						const auto paused = learner->pause();
 						saveSession(replayBuffer, checkpoint);
 					}
 				}
+
+				if (finishedEpisodes % 100 == 0)
+				{
+					stages.log();
+				}
 			}
+
+			stages.store.record(std::chrono::steady_clock::now() - storeStart);
+
+			if (learner)
+			{
+				learner->stepped(environmentCount);
+			}
+
+			std::ranges::copy(environments.observations(), currentStates.begin());
 		}
 
+		stages.log();
+
 		if (trainingMode)
 		{
+			learner.reset();
 			saveSession(replayBuffer, checkpoint);
 		}
 	}
 
+	// Times optimizeNetwork on a replay buffer of random transitions, once with the timing mask
+	// built element by element and once with tensor operations, and counts what a step allocates. No game is needed.
+	void benchmark(const HyperParameters& hp, uint64_t batches)
+	{
+		const CountingAllocator& allocator = CountingAllocator::install();
+
+		auto network = std::make_shared<DQN>(DQNStates, DQNActions, DQNTimings);
+		auto targetNetwork = std::make_shared<DQN>(DQNStates, DQNActions, DQNTimings);
+		copyParameters(*network, *targetNetwork);
+
+		auto optimizer =
+			std::make_shared<torch::optim::Adam>(
+				network->parameters(),
+				torch::optim::AdamOptions(hp.learningRate));
+
+		MultiRingBuffer<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize> replayBuffer(hp.replayBufferSize, hp.prioritized);
+		auto batch = replayBuffer.batch(hp.batchSize);
+
+		OptimizationContext<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize> optContext{
+			network,
+			targetNetwork,
+			optimizer,
+			replayBuffer,
+			batch,
+			hp
+		};
+
+		std::uniform_real_distribution<float> rewards(-1.0f, GoalBonus);
+
+		const auto randomTransition = [&]
+		{
+			std::array<float, DQNStates> state;
+			std::array<float, DQNTimings> timings;
+			std::array<float, DQNStates> nextState;
+
+			std::ranges::generate(state, [&] { return random(FloatDist); });
+			std::ranges::generate(timings, [&] { return random(FloatDist); });
+			std::ranges::generate(nextState, [&] { return random(FloatDist); });
+
+			return std::make_tuple(
+				state,
+				std::bitset<DQNKeys>(static_cast<uint64_t>(random(ActionDist))),
+				timings,
+				random(rewards),
+				nextState,
+				random(FloatDist) < 0.1f);
+		};
+
+		for (uint32_t i = 0; i < hp.replayBufferSize; ++i)
+		{
+			std::apply([&](auto&&... fields) { replayBuffer.emplace<Ugly>(fields...); }, randomTransition());
+			std::apply([&](auto&&... fields) { replayBuffer.emplace<Bad>(fields...); }, randomTransition());
+			std::apply([&](auto&&... fields) { replayBuffer.emplace<Good>(fields...); }, randomTransition());
+		}
+
+		replayBuffer.sampleStratifiedBatch(batch);
+
+		timingMaskLoop(optContext);
+		const torch::Tensor expected = optContext.mask.clone();
+		timingMask(optContext);
+
+		if (!optContext.mask.equal(expected))
+		{
+			throw std::runtime_error("The timing masks differ");
+		}
+
+		// The first steps pay for allocations that later ones reuse
+		for (uint64_t i = 0; i < std::min<uint64_t>(batches, 10); ++i)
+		{
+			optimizeNetwork(optContext);
+		}
+
+		Histogram loop;
+		Histogram tensorized;
+
+		for (uint64_t i = 0; i < batches; ++i)
+		{
+			ScopedLatency latency(loop);
+			optimizeNetwork<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize, timingMaskLoop<DQNStates, DQNKeys, DQNTimings, MultiRingBufferSize>>(optContext);
+		}
+
+		const uint64_t allocations = allocator.allocations();
+		const uint64_t bytes = allocator.bytes();
+
+		for (uint64_t i = 0; i < batches; ++i)
+		{
+			ScopedLatency latency(tensorized);
+			optimizeNetwork(optContext);
+		}
+
+		const double steps = static_cast<double>(std::max<uint64_t>(batches, 1));
+
+		LOGI("Batch size: {}, batches: {}", hp.batchSize, batches);
+		LOGI("Loop mask   | {}", loop);
+		LOGI("Tensor mask | {}", tensorized);
+		LOGI("Speedup: {:.2f}x", loop.meanMicroseconds() / std::max(tensorized.meanMicroseconds(), 1e-3));
+		LOGI("CPU allocations per step: {:.1f} ({:.1f} KiB)",
+			static_cast<double>(allocator.allocations() - allocations) / steps,
+			static_cast<double>(allocator.bytes() - bytes) / steps / 1024.0);
+	}
+
 #ifdef WIN32
 	BOOL WINAPI consoleHandler(DWORD ctrlType)
 	{
@@ -544,13 +796,23 @@ int main(int argc, char** argv)
 	SetConsoleCtrlHandler(aita::consoleHandler, TRUE);
 	constexpr char GameFileName[] = "aitaonmatalin.exe";
 #else
+	// A game process that has exited must not take aitaRL down with it when its stdin is written
+	signal(SIGPIPE, SIG_IGN);
 	constexpr int ERROR_BAD_ARGUMENTS = EINVAL;
-	constexpr int ERROR_CANCELLED = ECANCELED;
 	constexpr char GameFileName[] = "aitaonmatalin";
 #endif
 
 	aita::LOGI("aitaRL");
 
+	// The key scheduler logs while it stops, so it stops here on every way out of main() and not during static destruction
+	struct KeySchedulerShutdown
+	{
+		~KeySchedulerShutdown()
+		{
+			aita::KeyScheduler::shutdown();
+		}
+	} keySchedulerShutdown;
+
 	try
 	{
 		using namespace aita;
@@ -558,28 +820,93 @@ int main(int argc, char** argv)
 
 		Arguments arguments(argc, argv);
 
-		const std::filesystem::path gamePath = arguments.parentPath() / GameFileName;
+		const std::string mode = arguments.get("--mode", "play");
 
-		if (!std::filesystem::exists(gamePath))
+		// Needs neither a game nor an environment
+		if (mode == "benchmark")
 		{
-			throw std::runtime_error("Game executable not found: " + gamePath.string());
+			HyperParameters hp;
+			hp.parse(arguments);
+			LOGI("Starting in benchmark mode");
+			benchmark(hp, arguments.get<uint64_t>("--batches", DefaultBenchmarkBatches));
+			return 0;
 		}
 
-		Process process(gamePath,
-		{ 
-				std::format("--width={}", WindowWidth),
-				std::format("--height={}", WindowHeight),
-				"--no-sound",
-				"--loop"
-		});
+		const std::string backend = arguments.get("--backend", "process");
+		const uint32_t environmentCount = arguments.get<uint32_t>("--envs", 1);
+		std::unique_ptr<ProcessPool> processes; // Outlives the environments that borrow from it
+		std::vector<std::unique_ptr<Environment>> environments;
 
-		process.start();
-#ifdef WIN32
-		ensureForegroundWindow(L"Aita on matalin - The Fence Jump Game");
-#endif
-		process.redirect(parseGameState);
+		if (environmentCount == 0)
+		{
+			LOGE("At least one environment is required");
+			return ERROR_BAD_ARGUMENTS;
+		}
 
-		const std::string mode = arguments.get("--mode", "play");
+		if (backend == "process")
+		{
+			const std::filesystem::path gamePath = arguments.parentPath() / GameFileName;
+
+			if (!std::filesystem::exists(gamePath))
+			{
+				throw std::runtime_error("Game executable not found: " + gamePath.string());
+			}
+
+			if (environmentCount > 1)
+			{
+				LOGE("The keyboard is shared by all processes, only one process environment is supported");
+				return ERROR_BAD_ARGUMENTS;
+			}
+
+			const std::string transport = arguments.get("--transport", "pipe");
+
+			if (transport != "pipe" && transport != "shm")
+			{
+				LOGE("Unknown transport: {}", transport);
+				return ERROR_BAD_ARGUMENTS;
+			}
+
+			GameOptions options;
+			options.protocol = parseProtocol(arguments.get("--protocol", "text"));
+			options.sharedMemory = (transport == "shm");
+			options.telemetry = parseTelemetry(arguments.get("--telemetry", "changes"));
+			options.pipelined = arguments.contains("--pipeline");
+
+			environments.emplace_back(std::make_unique<ProcessEnvironment>(gamePath, options));
+		}
+		else if (backend == "lockstep")
+		{
+			const std::filesystem::path gamePath = arguments.parentPath() / GameFileName;
+
+			if (!std::filesystem::exists(gamePath))
+			{
+				throw std::runtime_error("Game executable not found: " + gamePath.string());
+			}
+
+			// No keyboard involved, every game process gets its own actions
+			const bool headless = arguments.contains("--headless");
+			processes = std::make_unique<ProcessPool>(gamePath, lockstepArguments(headless), environmentCount);
+
+			for (uint32_t i = 0; i < environmentCount; ++i)
+			{
+				environments.emplace_back(std::make_unique<LockstepEnvironment>(*processes, i));
+			}
+		}
+		else if (backend == "simulation")
+		{
+			for (uint32_t i = 0; i < environmentCount; ++i)
+			{
+				environments.emplace_back(std::make_unique<SimulatedEnvironment>());
+			}
+		}
+		else
+		{
+			LOGE("Unknown backend: {}", backend);
+			return ERROR_BAD_ARGUMENTS;
+		}
+
+		// The network learns on its own thread, with --pipeline the next action is also decided while the keys are held
+		VectorEnvironment environment(std::move(environments));
 
 		if (arguments.contains("--example"))
 		{
@@ -598,24 +925,20 @@ int main(int argc, char** argv)
 			HyperParameters hp;
 			hp.parse(arguments);
 			LOGI("Starting in play mode");
-			run(false, process, hp);
+			run(false, environment, hp);
 		}
 		else if (mode == "train")
 		{
 			HyperParameters hp;
 			hp.parse(arguments);
 			LOGI("Starting in training mode");
-			run(true, process, hp);
+			run(true, environment, hp);
 		}
 		else
 		{
 			LOGE("Bad arguments");
 			return ERROR_BAD_ARGUMENTS;
 		}
-
-		process.terminate(ERROR_CANCELLED);
-		process.waitForExit();
-
 	}
 	catch (const std::system_error& ex)
 	{
@@ -1,16 +1,42 @@
 #pragma once
 
 #include "Logger.hpp"
+#include "RL.hpp"
+#include "SumTree.hpp"
 
 namespace aita
 {
-	template<typename T, size_t N>
+	// Rings of transitions that any number of actors store into while a learner samples them.
+	// The transitions are kept as columns: one tensor each for the states, actions, timings, rewards,
+	// next states and done flags, with the N rings stacked in their rows. A batch is gathered straight
+	// into preallocated tensors with one index_select per column.
+	// A writer reserves a row with one atomic increment and fills it under the row's own seqlock:
+	// the sequence is odd while the row is written. Rows that changed during a gather are copied again,
+	// so inserts never wait for sampling and a sampled transition is never torn.
+	// Prioritized, every row also has a priority in a sum tree over all the rings, and batches are drawn
+	// in proportion to it. Only the learner locks the tree: an insert pushes its row onto a lock-free list of its ring,
+	// which the learner drains into the tree at the highest priority so far before it samples.
+	template<size_t S, size_t K, size_t T, size_t N>
 	class MultiRingBuffer
 	{
 	public:
+		// Preallocated tensors a batch is gathered into
+		struct Batch
+		{
+			torch::Tensor states; // [size, S]
+			torch::Tensor actions; // [size, 1], the key bits as an index
+			torch::Tensor timings; // [size, T]
+			torch::Tensor rewards; // [size]
+			torch::Tensor nextStates; // [size, S]
+			torch::Tensor dones; // [size]
+			torch::Tensor rows; // [size], where each transition came from
+			torch::Tensor weights; // [size], importance sampling weights, ones unless prioritized
+			std::vector<uint64_t> sequences;
+		};
+
 		MultiRingBuffer() = delete;
 
-		explicit MultiRingBuffer(size_t size) :
+		explicit MultiRingBuffer(size_t size, bool prioritized = false) :
 			_size(size)
 		{
 			if (_size == 0)
@@ -18,64 +44,105 @@ namespace aita
 				throw std::runtime_error("Size must be greater than zero");
 			}
 
-			_indices.fill(0);
-			_counts.fill(0);
+			const int64_t rows = static_cast<int64_t>(_size * N);
+
+			_states = torch::zeros({ rows, static_cast<int64_t>(S) }, torch::kFloat32);
+			_actions = torch::zeros({ rows, 1 }, torch::kInt64);
+			_timings = torch::zeros({ rows, static_cast<int64_t>(T) }, torch::kFloat32);
+			_rewards = torch::zeros({ rows }, torch::kFloat32);
+			_nextStates = torch::zeros({ rows, static_cast<int64_t>(S) }, torch::kFloat32);
+			_dones = torch::zeros({ rows }, torch::kBool);
+			_sequences = std::make_unique<std::atomic<uint64_t>[]>(_size * N);
 
-			for (auto& vec : _data)
+			if (prioritized)
 			{
-				vec.resize(_size);
+				_priorities = std::make_unique<SumTree>(_size * N);
+				_nextFresh = std::make_unique<size_t[]>(_size * N);
+				_queued = std::make_unique<std::atomic<bool>[]>(_size * N);
 			}
-		}
 
-		template<size_t Index, typename... Args>
-		void emplace(Args&&... args)
-		{
-			static_assert(Index < N, "Buffer index out of bounds");
+			for (std::atomic<size_t>& head : _fresh)
+			{
+				head.store(NoRow);
+			}
+		}
 
-			size_t& index = _indices[Index];
-			size_t& count = _counts[Index];
+		MultiRingBuffer(const MultiRingBuffer&) = delete;
+		MultiRingBuffer& operator = (const MultiRingBuffer&) = delete;
 
-			_data[Index][index] = T(std::forward<Args>(args)...);
+		Batch batch(size_t size) const
+		{
+			const int64_t rows = static_cast<int64_t>(size);
 
-			index = (index + 1) % _size;
-			count += (count < _size);
+			return
+			{
+				torch::empty({ rows, static_cast<int64_t>(S) }, torch::kFloat32),
+				torch::empty({ rows, 1 }, torch::kInt64),
+				torch::empty({ rows, static_cast<int64_t>(T) }, torch::kFloat32),
+				torch::empty({ rows }, torch::kFloat32),
+				torch::empty({ rows, static_cast<int64_t>(S) }, torch::kFloat32),
+				torch::empty({ rows }, torch::kBool),
+				torch::empty({ rows }, torch::kInt64),
+				torch::ones({ rows }, torch::kFloat32),
+				std::vector<uint64_t>(size)
+			};
 		}
 
 		template<size_t Index>
-		void randomSample(std::span<T> samples) const
+		void emplace(
+			const std::array<float, S>& state,
+			std::bitset<K> action,
+			const std::array<float, T>& timings,
+			float reward,
+			const std::array<float, S>& nextState,
+			bool done)
 		{
 			static_assert(Index < N, "Buffer index out of bounds");
 
-			const size_t count = _counts[Index];
+			const uint64_t ticket = _reserved[Index].fetch_add(1, std::memory_order_relaxed);
+			const size_t row = Index * _size + ticket % _size;
 
-			if (samples.empty())
-			{
-				throw std::runtime_error("Resize the sample buffer accordingly");
-			}
+			std::atomic<uint64_t>& sequence = _sequences[row];
+			const uint64_t current = sequence.load(std::memory_order_relaxed);
 
-			if (samples.size() > count)
+			sequence.store(current + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			std::memcpy(_states.data_ptr<float>() + row * S, state.data(), S * sizeof(float));
+			_actions.data_ptr<int64_t>()[row] = static_cast<int64_t>(action.to_ullong());
+			std::memcpy(_timings.data_ptr<float>() + row * T, timings.data(), T * sizeof(float));
+			_rewards.data_ptr<float>()[row] = reward;
+			std::memcpy(_nextStates.data_ptr<float>() + row * S, nextState.data(), S * sizeof(float));
+			_dones.data_ptr<bool>()[row] = done;
+
+			sequence.store(current + 2, std::memory_order_release);
+
+			// Queued for the learner to give it the highest priority, a row already waiting is not queued twice
+			if (_priorities && !_queued[row].exchange(true, std::memory_order_acquire))
 			{
-				throw std::runtime_error("Not enough elements pushed");
-			}
+				size_t head = _fresh[Index].load(std::memory_order_relaxed);
 
-			thread_local std::random_device device;
-			thread_local std::mt19937 engine(device());
+				do
+				{
+					_nextFresh[row] = head;
+				}
+				while (!_fresh[Index].compare_exchange_weak(head, row, std::memory_order_release, std::memory_order_relaxed));
+			}
 
-			const auto& vec = _data[Index];
+			// Rows may be filled out of order, the count only covers the highest one filled
+			const size_t filled = static_cast<size_t>(std::min<uint64_t>(ticket + 1, _size));
+			size_t count = _counts[Index].load(std::memory_order_relaxed);
 
-			std::sample(
-				vec.begin(),
-				vec.begin() + static_cast<std::ptrdiff_t>(count),
-				samples.begin(),
-				samples.size(),
-				engine);
+			while (count < filled && !_counts[Index].compare_exchange_weak(count, filled, std::memory_order_release))
+			{
+			}
 		}
 
 		template<size_t Index>
 		size_t count() const
 		{
 			static_assert(Index < N, "Buffer index out of bounds");
-			return _counts[Index];
+			return _counts[Index].load(std::memory_order_acquire);
 		}
 
 		size_t size() const
@@ -83,16 +150,23 @@ namespace aita
 			return _size;
 		}
 
+		bool prioritized() const
+		{
+			return _priorities != nullptr;
+		}
+
 		bool isReadyForBatch(size_t batchSize) const
 		{
-			return std::ranges::none_of(_counts, [](size_t c) { return c == 0; });
+			return std::ranges::none_of(_counts, [](const std::atomic<size_t>& c) { return c.load(std::memory_order_acquire) == 0; });
 		}
 
-		void sampleStratifiedBatch(std::span<T> batch) const
+		void sampleStratifiedBatch(Batch& batch) const
 		{
-			const size_t baseSize = batch.size() / N;
-			const size_t remainder = batch.size() % N;
+			const size_t size = batch.sequences.size();
+			const size_t baseSize = size / N;
+			const size_t remainder = size % N;
 
+			int64_t* const rows = batch.rows.template data_ptr<int64_t>();
 			size_t offset = 0;
 
 			thread_local std::random_device device;
@@ -107,20 +181,137 @@ namespace aita
 					continue;
 				}
 
-				std::uniform_int_distribution<size_t> dist(0, _counts[i] - 1);
+				std::uniform_int_distribution<size_t> dist(0, _counts[i].load(std::memory_order_acquire) - 1);
 
-				for (size_t j = 0; j < count; ++j)
+				for (size_t j = offset; j < offset + count; ++j)
 				{
-					batch[offset + j] = _data[i][dist(engine)];
+					size_t row = 0;
+					uint64_t sequence = 0;
+
+					// Rows that were never filled are drawn again, rows being written are waited for
+					do
+					{
+						row = i * _size + dist(engine);
+						sequence = stableSequence(row);
+					}
+					while (sequence == 0);
+
+					rows[j] = static_cast<int64_t>(row);
+					batch.sequences[j] = sequence;
 				}
 
 				offset += count;
 			}
+
+			gather(batch);
+		}
+
+		// Draws every row of the batch in proportion to its priority, in one pass down the sum tree:
+		// the total is split into as many equal segments as there are rows and one value is drawn from each.
+		// The weights correct for the bias, (n * P(i))^-beta scaled so that the largest in the batch is 1.
+		void samplePrioritizedBatch(Batch& batch, float beta) const
+		{
+			const size_t size = batch.sequences.size();
+
+			int64_t* const rows = batch.rows.template data_ptr<int64_t>();
+			float* const weights = batch.weights.template data_ptr<float>();
+
+			thread_local std::random_device device;
+			thread_local std::mt19937 engine(device());
+			std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+			double filled = 0.0;
+
+			for (const std::atomic<size_t>& count : _counts)
+			{
+				filled += static_cast<double>(count.load(std::memory_order_acquire));
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_priorityMutex);
+				drainFresh();
+
+				const double total = _priorities->total();
+				const double segment = total / static_cast<double>(size);
+
+				for (size_t j = 0; j < size; ++j)
+				{
+					const double value = std::min((static_cast<double>(j) + dist(engine)) * segment, std::nextafter(total, 0.0));
+					const size_t row = _priorities->find(value);
+					const double probability = _priorities->priority(row) / total;
+
+					rows[j] = static_cast<int64_t>(row);
+					weights[j] = static_cast<float>(std::pow(filled * probability, -static_cast<double>(beta)));
+				}
+			}
+
+			const float largest = *std::max_element(weights, weights + size);
+
+			for (size_t j = 0; j < size; ++j)
+			{
+				weights[j] /= largest;
+				batch.sequences[j] = stableSequence(static_cast<size_t>(rows[j]));
+			}
+
+			gather(batch);
+		}
+
+		// Priorities of the sampled rows, with the TD errors already raised to alpha.
+		// Rows overwritten since they were sampled keep the priority of their new transition.
+		void updatePriorities(const Batch& batch, std::span<const float> priorities)
+		{
+			const int64_t* const rows = batch.rows.template data_ptr<int64_t>();
+
+			std::lock_guard<std::mutex> lock(_priorityMutex);
+
+			for (size_t j = 0; j < priorities.size(); ++j)
+			{
+				const size_t row = static_cast<size_t>(rows[j]);
+
+				if (_sequences[row].load(std::memory_order_acquire) != batch.sequences[j])
+				{
+					continue;
+				}
+
+				_priorities->update(row, priorities[j]);
+				_maxPriority = std::max<double>(_maxPriority, priorities[j]);
+			}
+		}
+
+		// Fills the columns of the batch from its rows and copies again the ones rewritten meanwhile
+		void gather(Batch& batch) const
+		{
+			const size_t size = batch.sequences.size();
+			const int64_t* const rows = batch.rows.template data_ptr<int64_t>();
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			torch::index_select_out(batch.states, _states, 0, batch.rows);
+			torch::index_select_out(batch.actions, _actions, 0, batch.rows);
+			torch::index_select_out(batch.timings, _timings, 0, batch.rows);
+			torch::index_select_out(batch.rewards, _rewards, 0, batch.rows);
+			torch::index_select_out(batch.nextStates, _nextStates, 0, batch.rows);
+			torch::index_select_out(batch.dones, _dones, 0, batch.rows);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			for (size_t j = 0; j < size; ++j)
+			{
+				const size_t row = static_cast<size_t>(rows[j]);
+
+				if (_sequences[row].load(std::memory_order_relaxed) != batch.sequences[j])
+				{
+					recopy(row, batch, j);
+				}
+			}
 		}
 
+		// Saving and loading must not overlap with emplace(). The file holds whole transitions, one after the other.
 		friend std::ostream& operator << (std::ostream& os, const MultiRingBuffer& buffer)
 		{
-			constexpr size_t elementSize = sizeof(T);
+			using Element = Transition<S, K, T>;
+
+			constexpr size_t elementSize = sizeof(Element);
 			constexpr size_t bufferCount = N;
 
 			os.write(reinterpret_cast<const char*>(&elementSize), sizeof(elementSize));
@@ -129,9 +320,17 @@ namespace aita
 
 			for (size_t i = 0; i < N; ++i)
 			{
-				os.write(reinterpret_cast<const char*>(&buffer._indices[i]), sizeof(buffer._indices[i]));
-				os.write(reinterpret_cast<const char*>(&buffer._counts[i]), sizeof(buffer._counts[i]));
-				os.write(reinterpret_cast<const char*>(buffer._data[i].data()), buffer._size * elementSize);
+				const size_t index = static_cast<size_t>(buffer._reserved[i].load() % buffer._size);
+				const size_t count = buffer._counts[i].load();
+
+				os.write(reinterpret_cast<const char*>(&index), sizeof(index));
+				os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+				for (size_t j = 0; j < buffer._size; ++j)
+				{
+					const Element element = buffer.transition(i * buffer._size + j);
+					os.write(reinterpret_cast<const char*>(&element), elementSize);
+				}
 			}
 
 			return os;
@@ -139,10 +338,12 @@ namespace aita
 
 		friend std::istream& operator >> (std::istream& is, MultiRingBuffer& buffer)
 		{
+			using Element = Transition<S, K, T>;
+
 			size_t elementSize = 0;
 			is.read(reinterpret_cast<char*>(&elementSize), sizeof(elementSize));
 
-			if (elementSize != sizeof(T))
+			if (elementSize != sizeof(Element))
 			{
 				throw std::runtime_error("MultiRingBuffer element size mismatch");
 			}
@@ -165,9 +366,41 @@ namespace aita
 
 			for (size_t i = 0; i < N; ++i)
 			{
-				is.read(reinterpret_cast<char*>(&buffer._indices[i]), sizeof(buffer._indices[i]));
-				is.read(reinterpret_cast<char*>(&buffer._counts[i]), sizeof(buffer._counts[i]));
-				is.read(reinterpret_cast<char*>(buffer._data[i].data()), buffer._size * sizeof(T));
+				size_t index = 0;
+				size_t count = 0;
+
+				is.read(reinterpret_cast<char*>(&index), sizeof(index));
+				is.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+				buffer._reserved[i].store(index);
+				buffer._counts[i].store(count);
+
+				for (size_t j = 0; j < buffer._size; ++j)
+				{
+					Element element;
+					is.read(reinterpret_cast<char*>(&element), sizeof(Element));
+
+					const size_t row = i * buffer._size + j;
+					buffer.store(row, element);
+					buffer._sequences[row].store(j < count ? 2 : 0);
+				}
+			}
+
+			// The priorities are not saved, every loaded transition starts out as important as any other
+			if (buffer._priorities)
+			{
+				std::lock_guard<std::mutex> lock(buffer._priorityMutex);
+
+				buffer._priorities = std::make_unique<SumTree>(buffer._size * N);
+				buffer._maxPriority = 1.0;
+
+				for (size_t row = 0; row < buffer._size * N; ++row)
+				{
+					if (buffer._sequences[row].load() != 0)
+					{
+						buffer._priorities->update(row, 1.0);
+					}
+				}
 			}
 
 			return is;
@@ -208,9 +441,106 @@ namespace aita
 		}
 
 	private:
+		constexpr static size_t NoRow = std::numeric_limits<size_t>::max();
+
+		// Until it has been learned from, a new transition is as important as the most important one.
+		// The priority lock must be held.
+		void drainFresh() const
+		{
+			for (std::atomic<size_t>& head : _fresh)
+			{
+				for (size_t row = head.exchange(NoRow, std::memory_order_acquire); row != NoRow;)
+				{
+					// Read before the row may be queued again
+					const size_t next = _nextFresh[row];
+					_queued[row].store(false, std::memory_order_release);
+
+					_priorities->update(row, _maxPriority);
+					row = next;
+				}
+			}
+		}
+
+		// Waits out a write in progress. Zero if the row has never been filled.
+		uint64_t stableSequence(size_t row) const
+		{
+			uint64_t sequence = _sequences[row].load(std::memory_order_acquire);
+
+			while (sequence & 1)
+			{
+				sequence = _sequences[row].load(std::memory_order_acquire);
+			}
+
+			return sequence;
+		}
+
+		// The slow path for a row that was rewritten while the batch was gathered
+		void recopy(size_t row, Batch& batch, size_t index) const
+		{
+			while (true)
+			{
+				const uint64_t sequence = stableSequence(row);
+				const Transition<S, K, T> element = transition(row);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+
+				if (_sequences[row].load(std::memory_order_relaxed) != sequence)
+				{
+					continue;
+				}
+
+				std::memcpy(batch.states.template data_ptr<float>() + index * S, element.state.data(), S * sizeof(float));
+				batch.actions.template data_ptr<int64_t>()[index] = static_cast<int64_t>(element.action.to_ullong());
+				std::memcpy(batch.timings.template data_ptr<float>() + index * T, element.timings.data(), T * sizeof(float));
+				batch.rewards.template data_ptr<float>()[index] = element.reward;
+				std::memcpy(batch.nextStates.template data_ptr<float>() + index * S, element.nextState.data(), S * sizeof(float));
+				batch.dones.template data_ptr<bool>()[index] = element.done;
+				batch.sequences[index] = sequence;
+				return;
+			}
+		}
+
+		Transition<S, K, T> transition(size_t row) const
+		{
+			Transition<S, K, T> element = {};
+
+			std::memcpy(element.state.data(), _states.data_ptr<float>() + row * S, S * sizeof(float));
+			element.action = std::bitset<K>(static_cast<uint64_t>(_actions.data_ptr<int64_t>()[row]));
+			std::memcpy(element.timings.data(), _timings.data_ptr<float>() + row * T, T * sizeof(float));
+			element.reward = _rewards.data_ptr<float>()[row];
+			std::memcpy(element.nextState.data(), _nextStates.data_ptr<float>() + row * S, S * sizeof(float));
+			element.done = _dones.data_ptr<bool>()[row];
+
+			return element;
+		}
+
+		void store(size_t row, const Transition<S, K, T>& element)
+		{
+			std::memcpy(_states.data_ptr<float>() + row * S, element.state.data(), S * sizeof(float));
+			_actions.data_ptr<int64_t>()[row] = static_cast<int64_t>(element.action.to_ullong());
+			std::memcpy(_timings.data_ptr<float>() + row * T, element.timings.data(), T * sizeof(float));
+			_rewards.data_ptr<float>()[row] = element.reward;
+			std::memcpy(_nextStates.data_ptr<float>() + row * S, element.nextState.data(), S * sizeof(float));
+			_dones.data_ptr<bool>()[row] = element.done;
+		}
+
 		size_t _size;
-		std::array<size_t, N> _indices;
-		std::array<size_t, N> _counts;
-		std::array<std::vector<T>, N> _data;
+		std::array<std::atomic<uint64_t>, N> _reserved = {}; // Tickets handed out to writers, the row is the ticket modulo the size
+		std::array<std::atomic<size_t>, N> _counts = {};
+		std::unique_ptr<std::atomic<uint64_t>[]> _sequences; // Zero until the row is filled the first time
+
+		torch::Tensor _states;
+		torch::Tensor _actions;
+		torch::Tensor _timings;
+		torch::Tensor _rewards;
+		torch::Tensor _nextStates;
+		torch::Tensor _dones;
+
+		std::unique_ptr<SumTree> _priorities; // Only when prioritized
+		mutable std::mutex _priorityMutex;
+		double _maxPriority = 1.0; // Given to new transitions
+		mutable std::array<std::atomic<size_t>, N> _fresh; // Heads of the lists of rows waiting for a priority
+		std::unique_ptr<size_t[]> _nextFresh; // Links of those lists
+		std::unique_ptr<std::atomic<bool>[]> _queued;
 	};
 }
\ No newline at end of file
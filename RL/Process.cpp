@@ -1,5 +1,7 @@
 #include "Process.hpp"
+#include "LineReader.hpp"
 #include "Logger.hpp"
+#include "Reactor.hpp"
 
 namespace aita
 {
@@ -23,6 +25,16 @@ namespace aita
 		{
 			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "Failed to set output pipe handle information");
 		}
+
+		if (!CreatePipe(_inputReadHandle.addressOf(), _inputWriteHandle.addressOf(), &sa, 0))
+		{
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "Failed to create input pipe");
+		}
+
+		if (!SetHandleInformation(_inputWriteHandle, HANDLE_FLAG_INHERIT, 0))
+		{
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "Failed to set input pipe handle information");
+		}
 	}
 
 	void Process::start()
@@ -32,12 +44,14 @@ namespace aita
 			throw std::runtime_error("Process is already created.");
 		}
 
+		_started = std::chrono::steady_clock::now();
+
 		STARTUPINFOA startupInfo;
 		ZeroMemory(&startupInfo, sizeof(STARTUPINFOA));
 		startupInfo.cb = sizeof(STARTUPINFOA);
 		startupInfo.hStdError = _outputWriteHandle;
 		startupInfo.hStdOutput = _outputWriteHandle;
-		startupInfo.hStdInput = nullptr;
+		startupInfo.hStdInput = _inputReadHandle;
 		startupInfo.dwFlags |= STARTF_USESTDHANDLES;
 
 		PROCESS_INFORMATION processInformation;
@@ -66,8 +80,11 @@ namespace aita
 		_processHandle.reset(processInformation.hProcess);
 		_threadHandle.reset(processInformation.hThread);
 		_outputWriteHandle.reset();
+		_inputReadHandle.reset();
 	}
 
+	Process::~Process() = default;
+
 	void Process::redirectTo(void* where)
 	{
 		const auto how = [where](std::string_view output)
@@ -81,14 +98,11 @@ namespace aita
 		return redirect(how);
 	}
 
-	std::optional<std::string> Process::read()
+	std::optional<size_t> Process::read(std::span<char> buffer)
 	{
-		constexpr size_t bufferSize = 0x1000;
-		thread_local char buffer[bufferSize];
-
 		DWORD bytesRead = 0;
 
-		if (!ReadFile(_outputReadHandle, buffer, bufferSize - 1, &bytesRead, nullptr))
+		if (!ReadFile(_outputReadHandle, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesRead, nullptr))
 		{
 			const DWORD error = GetLastError();
 
@@ -101,7 +115,58 @@ namespace aita
 			throw std::system_error(static_cast<int>(error), std::system_category(), "Failed to read from process output pipe");
 		}
 
-		return std::string(buffer, bytesRead);
+		return static_cast<size_t>(bytesRead);
+	}
+
+	bool Process::waitForOutput(std::chrono::milliseconds timeout)
+	{
+		// Anonymous pipes cannot be waited on, so peek until the deadline
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+		for (;;)
+		{
+			DWORD available = 0;
+
+			if (!PeekNamedPipe(_outputReadHandle, nullptr, 0, nullptr, &available, nullptr))
+			{
+				const DWORD error = GetLastError();
+
+				// The next read reports the closed pipe
+				if (error == ERROR_BROKEN_PIPE)
+				{
+					return true;
+				}
+
+				throw std::system_error(static_cast<int>(error), std::system_category(), "Failed to peek at process output pipe");
+			}
+
+			if (available > 0)
+			{
+				return true;
+			}
+
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				return false;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void Process::write(std::string_view input)
+	{
+		while (!input.empty())
+		{
+			DWORD bytesWritten = 0;
+
+			if (!WriteFile(_inputWriteHandle, input.data(), static_cast<DWORD>(input.size()), &bytesWritten, nullptr))
+			{
+				throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "Failed to write to process input pipe");
+			}
+
+			input.remove_prefix(bytesWritten);
+		}
 	}
 
 	bool Process::isRunning() const
@@ -140,20 +205,112 @@ namespace aita
 
 		return result == WAIT_OBJECT_0;
 	}
+
+	void Process::redirect(std::function<void(std::string_view)> how)
+	{
+		_thread = std::jthread([this, how]()
+		{
+			// The chunks are handed out straight from the read buffer
+			std::array<char, 0x1000> buffer;
+
+			pump(
+				[&] { return std::span<char>(buffer); },
+				[&](size_t count) { how(std::string_view(buffer.data(), count)); });
+		});
+	}
+
+	void Process::redirectLines(std::function<void(std::string_view)> how)
+	{
+		_thread = std::jthread([this, how]()
+		{
+			LineReader reader;
+
+			pump(
+				[&] { return reader.writable(); },
+				[&](size_t count) { reader.commit(count, how); });
+
+			LOGI("Process output: {} bytes | {} lines | {} partial lines carried | {} overflows",
+				reader.bytes(),
+				reader.lines(),
+				reader.carries(),
+				reader.overflows());
+		});
+	}
+
+	void Process::pump(const std::function<std::span<char>()>& writable, const std::function<void(size_t)>& commit)
+	{
+		try
+		{
+			while (isRunning())
+			{
+				const std::optional<size_t> count = read(writable());
+
+				if (!count.has_value())
+				{
+					break;
+				}
+
+				if (count.value() == 0)
+				{
+					continue;
+				}
+
+				commit(count.value());
+			}
+
+			LOGI("Process exited with code: {}", exitCode());
+		}
+		catch (const std::system_error& ex)
+		{
+			LOGE("System error in process output redirection: {} (code: {})", ex.what(), ex.code().value());
+		}
+		catch (const std::exception& ex)
+		{
+			LOGE("Error in process output redirection: {}", ex.what());
+		}
+	}
 #else
+	namespace
+	{
+		int exitCodeOf(int status)
+		{
+			if (WIFEXITED(status))
+			{
+				return WEXITSTATUS(status);
+			}
+
+			if (WIFSIGNALED(status))
+			{
+				return WTERMSIG(status);
+			}
+
+			LOGE("Process exited with unknown status: {}", status);
+			return -1;
+		}
+	}
+
 	Process::Process(const std::filesystem::path& path, const std::vector<std::string>& arguments) :
 		_path(path),
 		_arguments(arguments)
 	{
 		int pipefd[2];
 
-		if (pipe(pipefd) == -1)
+		// Close on exec, so the other game processes do not inherit the pipes of this one
+		if (pipe2(pipefd, O_CLOEXEC) == -1)
 		{
 			throw std::system_error(errno, std::system_category(), "Failed to create output pipe");
 		}
 
 		_outputReadDescriptor.reset(pipefd[0]);
 		_outputWriteDescriptor.reset(pipefd[1]);
+
+		if (pipe2(pipefd, O_CLOEXEC) == -1)
+		{
+			throw std::system_error(errno, std::system_category(), "Failed to create input pipe");
+		}
+
+		_inputReadDescriptor.reset(pipefd[0]);
+		_inputWriteDescriptor.reset(pipefd[1]);
 	}
 
 	void Process::start()
@@ -163,49 +320,160 @@ namespace aita
 			throw std::runtime_error("Process is already created.");
 		}
 
-		_pid = fork();
+		_started = std::chrono::steady_clock::now();
+
+		// posix_spawn does not copy the address space of the parent, which has libtorch mapped
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
 
-		switch (_pid)
+		if (_outputWriteDescriptor != STDOUT_FILENO)
 		{
-			case -1:
-			{
-				throw std::system_error(errno, std::system_category(), "Failed to fork process");
-			}
-			case 0: // Child process
-			{
-				if (_outputWriteDescriptor != STDOUT_FILENO)
-				{
-					dup2(_outputWriteDescriptor, STDOUT_FILENO);
-				}
+			posix_spawn_file_actions_adddup2(&actions, _outputWriteDescriptor, STDOUT_FILENO);
+		}
 
-				if (_outputWriteDescriptor != STDERR_FILENO)
-				{
-					dup2(_outputWriteDescriptor, STDERR_FILENO);
-				}
+		if (_outputWriteDescriptor != STDERR_FILENO)
+		{
+			posix_spawn_file_actions_adddup2(&actions, _outputWriteDescriptor, STDERR_FILENO);
+		}
 
-				_outputWriteDescriptor.reset();
-				_outputReadDescriptor.reset();
+		if (_inputReadDescriptor != STDIN_FILENO)
+		{
+			posix_spawn_file_actions_adddup2(&actions, _inputReadDescriptor, STDIN_FILENO);
+		}
 
-				std::vector<char*> argv;
-				std::string applicationName = _path.string();
-				argv.push_back(applicationName.data());
+		std::vector<char*> argv;
+		std::string applicationName = _path.string();
+		argv.push_back(applicationName.data());
 
-				for (auto& s : _arguments)
-				{
-					argv.push_back(s.data());
-				}
+		for (auto& s : _arguments)
+		{
+			argv.push_back(s.data());
+		}
+
+		argv.push_back(nullptr);
+
+		const int error = posix_spawn(&_pid, applicationName.c_str(), &actions, nullptr, argv.data(), environ);
+		posix_spawn_file_actions_destroy(&actions);
+
+		if (error != 0)
+		{
+			_pid = -1;
+			throw std::system_error(error, std::system_category(), "Failed to spawn process");
+		}
 
-				argv.push_back(nullptr);
+		_outputWriteDescriptor.reset();
+		_inputReadDescriptor.reset();
 
-				execv(applicationName.c_str(), argv.data());
+		// Readable once the process exits, the reactor reaps it then so isRunning() only reads a flag
+		_processDescriptor.reset(static_cast<int>(syscall(SYS_pidfd_open, _pid, 0)));
+
+		if (!_processDescriptor.isValid())
+		{
+			LOGW("No process descriptor ({}), the exit is polled for", errno);
+			return;
+		}
+
+		_exitWatch = Reactor::instance().watch(-1, _processDescriptor, Framing::Chunks, nullptr, [this]
+		{
+			reap();
+		});
+	}
+
+	Process::~Process()
+	{
+		if (_watch.has_value())
+		{
+			Reactor::instance().unwatch(_watch.value());
+		}
+
+		if (_exitWatch.has_value())
+		{
+			Reactor::instance().unwatch(_exitWatch.value());
+		}
+	}
 
-				exit(errno);
+	void Process::redirect(std::function<void(std::string_view)> how)
+	{
+		_watch = Reactor::instance().watch(_outputReadDescriptor, -1, Framing::Chunks, std::move(how), [this]
+		{
+			poll();
+		});
+	}
+
+	void Process::redirectLines(std::function<void(std::string_view)> how)
+	{
+		_watch = Reactor::instance().watch(_outputReadDescriptor, -1, Framing::Lines, std::move(how), [this]
+		{
+			poll();
+		});
+	}
+
+	void Process::reap() const
+	{
+		std::lock_guard<std::mutex> lock(_reapMutex);
+
+		if (_exited)
+		{
+			return;
+		}
+
+		// The process descriptor is readable, so the child is a zombie and waitpid returns right away
+		int status = 0;
+		_exitCode = waitpid(_pid, &status, 0) == _pid ? exitCodeOf(status) : -1;
+		_exited = true;
+		_exited.notify_all();
+
+		LOGI("Process exited with code: {}", _exitCode);
+	}
+
+	bool Process::poll() const
+	{
+		// Only without a process descriptor, otherwise the reactor reaps the process
+		if (_exitWatch.has_value() || _exited)
+		{
+			return !_exited;
+		}
+
+		std::lock_guard<std::mutex> lock(_reapMutex);
+
+		if (_exited)
+		{
+			return false;
+		}
+
+		int status = 0;
+		const pid_t result = waitpid(_pid, &status, WNOHANG);
+
+		switch (result)
+		{
+			case -1:
+			{
+				const int errorCode = errno;
+
+				if (errorCode != ECHILD)
+				{
+					throw std::system_error(errorCode, std::generic_category(), "waitpid failed");
+				}
+
+				_exitCode = -1;
+				break;
+			}
+			case 0:
+			{
+				return true;
 			}
-			default: // Parent process
+			default:
 			{
-				_outputWriteDescriptor.reset();
+				assert(result == _pid);
+				_exitCode = exitCodeOf(status);
 			}
 		}
+
+		_exited = true;
+		_exited.notify_all();
+
+		LOGI("Process exited with code: {}", _exitCode);
+		return false;
 	}
 
 	void Process::redirectTo(void* where)
@@ -221,12 +489,9 @@ namespace aita
 		return redirect(how);
 	}
 
-	std::optional<std::string> Process::read()
+	std::optional<size_t> Process::read(std::span<char> buffer)
 	{
-		constexpr size_t bufferSize = 0x1000;
-		thread_local char buffer[bufferSize];
-
-		const ssize_t bytesRead = ::read(_outputReadDescriptor, buffer, bufferSize - 1);
+		const ssize_t bytesRead = ::read(_outputReadDescriptor, buffer.data(), buffer.size());
 
 		switch (bytesRead)
 		{
@@ -236,7 +501,7 @@ namespace aita
 
 				if (errorCode == EAGAIN || errorCode == EWOULDBLOCK || errorCode == EINTR)
 				{
-					return "";
+					return 0;
 				}
 
 				throw std::system_error(errorCode, std::system_category(), "Failed to read from process output pipe");
@@ -248,63 +513,64 @@ namespace aita
 			}
 			default:
 			{
-				return std::string(buffer, static_cast<size_t>(bytesRead));
+				return static_cast<size_t>(bytesRead);
 			}
 		}
 	}
 
-	bool Process::isRunning() const
+	bool Process::waitForOutput(std::chrono::milliseconds timeout)
 	{
-		if (_exited)
-		{
-			return false;
-		}
-
-		int status = 0;
-		const pid_t result = waitpid(_pid, &status, WNOHANG);
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		pollfd descriptor = { _outputReadDescriptor, POLLIN, 0 };
 
-		switch (result)
+		for (;;)
 		{
-			case -1:
-			{
-				const int errorCode = errno;
+			const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			const int result = ::poll(&descriptor, 1, static_cast<int>(std::max<int64_t>(remaining.count(), 0)));
 
-				if (errorCode == ECHILD)
+			if (result == -1)
+			{
+				if (errno == EINTR)
 				{
-					_exited = true;
-					_exitCode = -1;
-					return false;
+					continue;
 				}
 
-				throw std::system_error(errorCode, std::generic_category(), "waitpid failed");
-			}
-			case 0:
-			{
-				return true;
+				throw std::system_error(errno, std::system_category(), "Failed to poll process output pipe");
 			}
-			default:
-			{
-				assert(result == _pid);
 
-				_exited = true;
+			// A closed pipe counts too, the next read reports it
+			return result > 0;
+		}
+	}
 
-				if (WIFEXITED(status))
-				{
-					_exitCode = WEXITSTATUS(status);
-				}
-				else if (WIFSIGNALED(status))
-				{
-					_exitCode = WTERMSIG(status);
-				}
-				else
+	void Process::write(std::string_view input)
+	{
+		while (!input.empty())
+		{
+			const ssize_t bytesWritten = ::write(_inputWriteDescriptor, input.data(), input.size());
+
+			if (bytesWritten == -1)
+			{
+				if (errno == EINTR)
 				{
-					LOGE("Process exited with unknown status: {}", status);
-					_exitCode = -1;
+					continue;
 				}
 
-				return false;
+				throw std::system_error(errno, std::system_category(), "Failed to write to process input pipe");
 			}
+
+			input.remove_prefix(static_cast<size_t>(bytesWritten));
+		}
+	}
+
+	bool Process::isRunning() const
+	{
+		if (_pid == -1)
+		{
+			return false;
 		}
+
+		return poll();
 	}
 
 	void Process::terminate(int exitCode) const
@@ -337,60 +603,29 @@ namespace aita
 			return true;
 		}
 
-		int status;
+		if (_exitWatch.has_value())
+		{
+			_exited.wait(false);
+			return true;
+		}
+
+		std::lock_guard<std::mutex> lock(_reapMutex);
+
+		if (_exited)
+		{
+			return true;
+		}
+
+		int status = 0;
 
 		if (waitpid(_pid, &status, 0) == _pid)
 		{
+			_exitCode = exitCodeOf(status);
 			_exited = true;
-
-			if (WIFEXITED(status))
-			{
-				_exitCode = WEXITSTATUS(status);
-			}
-			else if (WIFSIGNALED(status))
-			{
-				_exitCode = WTERMSIG(status);
-			}
+			_exited.notify_all();
 		}
 
 		return true;
 	}
 #endif
-	void Process::redirect(std::function<void(std::string_view)> how)
-	{
-		_thread = std::jthread([this, how]()
-		{
-			try
-			{
-				while (isRunning())
-				{
-					const std::optional<std::string> output = read();
-
-					if (!output.has_value())
-					{
-						break;
-					}
-
-					const std::string value = output.value();
-
-					if (value.empty())
-					{
-						continue;
-					}
-
-					how(value);
-				}
-
-				LOGI("Process exited with code: {}", exitCode());
-			}
-			catch (const std::system_error& ex)
-			{
-				LOGE("System error in process output redirection: {} (code: {})", ex.what(), ex.code().value());
-			}
-			catch (const std::exception& ex)
-			{
-				LOGE("Error in process output redirection: {}", ex.what());
-			}
-		});
-	}
 }
\ No newline at end of file
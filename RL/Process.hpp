@@ -8,11 +8,16 @@ namespace aita
 	{	
 	public:
 		Process(const std::filesystem::path& path, const std::vector<std::string>& arguments);
+		~Process();
 
 		void start();
+		// Windows reads the output on a thread per process, elsewhere the reactor watches it
 		void redirect(std::function<void(std::string_view)> how);
+		void redirectLines(std::function<void(std::string_view)> how);
 		void redirectTo(void* where);
-		std::optional<std::string> read();
+		std::optional<size_t> read(std::span<char> buffer); // Zero if interrupted, nullopt when the pipe is closed
+		bool waitForOutput(std::chrono::milliseconds timeout); // False if nothing arrived in time
+		void write(std::string_view input);
 		bool isRunning() const;
 		void terminate(int) const;
 		int exitCode() const;
@@ -23,22 +28,44 @@ namespace aita
 			return isRunning();
 		}
 
+		// Anything the process produced is newer than this
+		inline std::chrono::steady_clock::time_point started() const
+		{
+			return _started;
+		}
+
 	private:
+#ifdef WIN32
+		void pump(const std::function<std::span<char>()>& writable, const std::function<void(size_t)>& commit);
+#else
+		void reap() const;
+		bool poll() const;
+#endif
+
 		const std::filesystem::path _path;
 		std::vector<std::string> _arguments;
-		std::jthread _thread;
+		std::chrono::steady_clock::time_point _started;
 
 #ifdef WIN32
+		std::jthread _thread;
 		WinHandle _processHandle;
 		WinHandle _threadHandle;
 		WinHandle _outputReadHandle;
 		WinHandle _outputWriteHandle;
+		WinHandle _inputReadHandle;
+		WinHandle _inputWriteHandle;
 #else
 		pid_t _pid = -1;
 		PosixHandle _outputReadDescriptor;
 		PosixHandle _outputWriteDescriptor;
+		PosixHandle _inputReadDescriptor;
+		PosixHandle _inputWriteDescriptor;
+		PosixHandle _processDescriptor;
+		std::optional<uint64_t> _watch; // The output
+		std::optional<uint64_t> _exitWatch; // The process descriptor, the reactor reaps the process
+		mutable std::mutex _reapMutex;
 		mutable int _exitCode = 0;
-		mutable bool _exited = false;
+		mutable std::atomic<bool> _exited = false;
 #endif
 	};
 }
\ No newline at end of file
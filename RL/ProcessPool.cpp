@@ -0,0 +1,91 @@
+#include "ProcessPool.hpp"
+#include "Logger.hpp"
+
+namespace aita
+{
+#ifdef WIN32
+	constexpr int ProcessCancelled = ERROR_CANCELLED;
+#else
+	constexpr int ProcessCancelled = ECANCELED;
+#endif
+
+	ProcessPool::ProcessPool(const std::filesystem::path& path, const std::vector<std::string>& arguments, size_t size) :
+		_path(path),
+		_arguments(arguments)
+	{
+		_processes.reserve(size);
+
+		for (size_t i = 0; i < size; ++i)
+		{
+			_processes.emplace_back(spawn());
+		}
+
+		LOGI("Spawned {} game processes", size);
+	}
+
+	ProcessPool::~ProcessPool()
+	{
+		for (const std::unique_ptr<Process>& process : _processes)
+		{
+			stop(*process);
+		}
+
+		if (_restarts > 0)
+		{
+			LOGI("Game processes restarted: {}", _restarts.load());
+		}
+	}
+
+	size_t ProcessPool::size() const
+	{
+		return _processes.size();
+	}
+
+	Process& ProcessPool::process(size_t index)
+	{
+		return *_processes.at(index);
+	}
+
+	bool ProcessPool::healthy(size_t index) const
+	{
+		return _processes.at(index)->isRunning();
+	}
+
+	Process& ProcessPool::restart(size_t index)
+	{
+		std::unique_ptr<Process>& process = _processes.at(index);
+
+		stop(*process);
+		process = spawn();
+
+		const uint64_t restarts = ++_restarts;
+		LOGW("Restarted game process {} ({} restarts so far)", index, restarts);
+
+		return *process;
+	}
+
+	uint64_t ProcessPool::restarts() const
+	{
+		return _restarts;
+	}
+
+	std::unique_ptr<Process> ProcessPool::spawn() const
+	{
+		auto process = std::make_unique<Process>(_path, _arguments);
+		process->start();
+		return process;
+	}
+
+	void ProcessPool::stop(Process& process)
+	{
+		try
+		{
+			process.terminate(ProcessCancelled);
+			process.waitForExit();
+		}
+		catch (const std::exception& ex)
+		{
+			LOGE("Failed to stop the game process: {}", ex.what());
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Process.hpp"
+
+namespace aita
+{
+	// Spawns every game process up front and replaces the ones that die.
+	// Environments borrow a process by index. restart() destroys the old Process, so a reference
+	// to it must not be kept across the call.
+	class ProcessPool
+	{
+	public:
+		ProcessPool(const std::filesystem::path& path, const std::vector<std::string>& arguments, size_t size);
+		~ProcessPool();
+
+		ProcessPool(const ProcessPool&) = delete;
+		ProcessPool& operator = (const ProcessPool&) = delete;
+
+		size_t size() const;
+		Process& process(size_t index);
+		bool healthy(size_t index) const;
+
+		// Stops the process if it is still running and spawns a fresh one in its place
+		Process& restart(size_t index);
+		uint64_t restarts() const;
+
+	private:
+		std::unique_ptr<Process> spawn() const;
+		static void stop(Process& process);
+
+		const std::filesystem::path _path;
+		const std::vector<std::string> _arguments;
+		std::vector<std::unique_ptr<Process>> _processes;
+		std::atomic<uint64_t> _restarts = 0;
+	};
+}
\ No newline at end of file
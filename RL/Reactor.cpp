@@ -0,0 +1,287 @@
+#include "Reactor.hpp"
+#include "Logger.hpp"
+
+#ifndef WIN32
+namespace aita
+{
+	namespace
+	{
+		// The epoll key of a descriptor is the watch id shifted left, with the low bit telling the process apart
+		constexpr uint64_t WakeUpKey = 0;
+		constexpr uint64_t ProcessBit = 1;
+		constexpr size_t MaxEvents = 64;
+
+		void add(int epoll, int descriptor, uint64_t key)
+		{
+			epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.u64 = key;
+
+			if (epoll_ctl(epoll, EPOLL_CTL_ADD, descriptor, &event) == -1)
+			{
+				throw std::system_error(errno, std::system_category(), "Failed to add a descriptor to epoll");
+			}
+		}
+	}
+
+	Reactor& Reactor::instance()
+	{
+		static Reactor instance;
+		return instance;
+	}
+
+	Reactor::Reactor() :
+		_epoll(epoll_create1(EPOLL_CLOEXEC)),
+		_wakeUp(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+	{
+		if (!_epoll.isValid())
+		{
+			throw std::system_error(errno, std::system_category(), "Failed to create epoll instance");
+		}
+
+		if (!_wakeUp.isValid())
+		{
+			throw std::system_error(errno, std::system_category(), "Failed to create wake up event");
+		}
+
+		add(_epoll, _wakeUp, WakeUpKey);
+
+		_thread = std::jthread([this](std::stop_token token)
+		{
+			run(token);
+		});
+	}
+
+	Reactor::~Reactor()
+	{
+		_thread.request_stop();
+
+		const uint64_t one = 1;
+
+		if (::write(_wakeUp, &one, sizeof(one)) == -1)
+		{
+			LOGE("Failed to wake up the reactor: {}", errno);
+		}
+
+		_thread.join();
+	}
+
+	uint64_t Reactor::watch(
+		int output,
+		int process,
+		Framing framing,
+		std::function<void(std::string_view)> onOutput,
+		std::function<void()> onExit)
+	{
+		if (output != -1)
+		{
+			// Level triggered with one read per readiness, so a chatty process cannot starve the others
+			const int flags = fcntl(output, F_GETFL);
+
+			if (flags == -1 || fcntl(output, F_SETFL, flags | O_NONBLOCK) == -1)
+			{
+				throw std::system_error(errno, std::system_category(), "Failed to make the output non-blocking");
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		const uint64_t id = _nextWatch++;
+
+		Watch& watch = _watches[id];
+		watch.output = output;
+		watch.process = process;
+		watch.onOutput = std::move(onOutput);
+		watch.onExit = std::move(onExit);
+
+		if (framing == Framing::Lines)
+		{
+			watch.lines = std::make_unique<LineReader>();
+		}
+
+		if (output != -1)
+		{
+			add(_epoll, output, id << 1);
+		}
+
+		if (process != -1)
+		{
+			add(_epoll, process, (id << 1) | ProcessBit);
+		}
+
+		return id;
+	}
+
+	void Reactor::unwatch(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const auto it = _watches.find(id);
+
+		if (it == _watches.end())
+		{
+			return;
+		}
+
+		remove(it->second.output);
+		remove(it->second.process);
+		_watches.erase(it);
+	}
+
+	void Reactor::run(std::stop_token token)
+	{
+		std::array<epoll_event, MaxEvents> events;
+
+		while (!token.stop_requested())
+		{
+			const int count = epoll_wait(_epoll, events.data(), static_cast<int>(events.size()), -1);
+
+			if (count == -1)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				LOGE("Reactor stopped, epoll_wait failed: {}", errno);
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			for (const epoll_event& event : std::span(events).first(static_cast<size_t>(count)))
+			{
+				const uint64_t key = event.data.u64;
+
+				if (key == WakeUpKey)
+				{
+					uint64_t value = 0;
+
+					if (::read(_wakeUp, &value, sizeof(value)) == -1 && errno != EAGAIN)
+					{
+						LOGE("Failed to read the reactor wake up event: {}", errno);
+					}
+
+					continue;
+				}
+
+				const uint64_t id = key >> 1;
+				const auto it = _watches.find(id);
+
+				// Removed by an earlier event of the same batch
+				if (it == _watches.end())
+				{
+					continue;
+				}
+
+				try
+				{
+					if (key & ProcessBit)
+					{
+						processExited(id, it->second);
+					}
+					else
+					{
+						readOutput(id, it->second);
+					}
+				}
+				catch (const std::system_error& ex)
+				{
+					LOGE("System error in process output redirection: {} (code: {})", ex.what(), ex.code().value());
+				}
+				catch (const std::exception& ex)
+				{
+					LOGE("Error in process output redirection: {}", ex.what());
+				}
+			}
+		}
+	}
+
+	void Reactor::readOutput(uint64_t id, Watch& watch)
+	{
+		const std::span<char> buffer = watch.lines ? watch.lines->writable() : std::span<char>(_chunk);
+		const ssize_t bytesRead = ::read(watch.output, buffer.data(), buffer.size());
+
+		switch (bytesRead)
+		{
+			case -1:
+			{
+				const int errorCode = errno;
+
+				if (errorCode == EAGAIN || errorCode == EWOULDBLOCK || errorCode == EINTR)
+				{
+					return;
+				}
+
+				closeOutput(id, watch);
+				throw std::system_error(errorCode, std::system_category(), "Failed to read from process output pipe");
+			}
+			case 0:
+			{
+				closeOutput(id, watch);
+				return;
+			}
+			default:
+			{
+				const size_t count = static_cast<size_t>(bytesRead);
+
+				if (watch.lines)
+				{
+					watch.lines->commit(count, watch.onOutput);
+				}
+				else
+				{
+					watch.onOutput(std::string_view(buffer.data(), count));
+				}
+			}
+		}
+	}
+
+	void Reactor::closeOutput(uint64_t id, Watch& watch)
+	{
+		LOGI("Pipe closed");
+
+		if (watch.lines)
+		{
+			LOGI("Process output: {} bytes | {} lines | {} partial lines carried | {} overflows",
+				watch.lines->bytes(),
+				watch.lines->lines(),
+				watch.lines->carries(),
+				watch.lines->overflows());
+		}
+
+		remove(watch.output);
+		watch.output = -1;
+
+		// Without a process descriptor the closed output is the only sign of the exit
+		if (watch.process == -1)
+		{
+			processExited(id, watch);
+		}
+	}
+
+	void Reactor::processExited(uint64_t id, Watch& watch)
+	{
+		remove(watch.process);
+		watch.process = -1;
+
+		if (!watch.exited)
+		{
+			watch.exited = true;
+			watch.onExit();
+		}
+
+		// The output may still hold what the process wrote right before exiting
+		if (watch.output == -1)
+		{
+			_watches.erase(id);
+		}
+	}
+
+	void Reactor::remove(int descriptor)
+	{
+		if (descriptor != -1 && epoll_ctl(_epoll, EPOLL_CTL_DEL, descriptor, nullptr) == -1)
+		{
+			LOGW("Failed to remove a descriptor from epoll: {}", errno);
+		}
+	}
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Handle.hpp"
+#include "LineReader.hpp"
+
+#ifndef WIN32
+namespace aita
+{
+	enum class Framing : uint8_t
+	{
+		Chunks, // The output is handed out as it is read
+		Lines // The output is split into lines, a line split between two reads is reassembled first
+	};
+
+	// One thread that watches the output pipes and the exits of every child process with a single epoll loop.
+	// The handlers run on the reactor thread, one at a time, and must not call back into the reactor.
+	class Reactor
+	{
+	public:
+		static Reactor& instance();
+
+		Reactor(const Reactor&) = delete;
+		Reactor& operator = (const Reactor&) = delete;
+		Reactor(Reactor&&) = delete;
+		Reactor& operator = (Reactor&&) = delete;
+
+		// The exit handler is called once the process descriptor becomes readable, or when the output closes
+		// if there is no process descriptor. Either descriptor may be -1, but not both.
+		// The descriptors must stay open until the watch is removed.
+		uint64_t watch(
+			int output,
+			int process,
+			Framing framing,
+			std::function<void(std::string_view)> onOutput,
+			std::function<void()> onExit);
+
+		// Once this returns the handlers of the watch are not running and never will again
+		void unwatch(uint64_t id);
+
+	private:
+		struct Watch
+		{
+			int output = -1;
+			int process = -1;
+			std::function<void(std::string_view)> onOutput;
+			std::function<void()> onExit;
+			std::unique_ptr<LineReader> lines;
+			bool exited = false;
+		};
+
+		Reactor();
+		~Reactor();
+
+		void run(std::stop_token token);
+		void readOutput(uint64_t id, Watch& watch);
+		void closeOutput(uint64_t id, Watch& watch);
+		void processExited(uint64_t id, Watch& watch);
+		void remove(int descriptor);
+
+		PosixHandle _epoll;
+		PosixHandle _wakeUp;
+		std::array<char, 0x10000> _chunk = {};
+		std::mutex _mutex;
+		std::unordered_map<uint64_t, Watch> _watches;
+		uint64_t _nextWatch = 1;
+		std::jthread _thread;
+	};
+}
+#endif
\ No newline at end of file
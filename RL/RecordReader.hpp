@@ -0,0 +1,40 @@
+#pragma once
+
+namespace aita
+{
+	// Reassembles fixed-size records from a byte stream that arrives in arbitrarily sized chunks
+	template <size_t Size>
+	class RecordReader
+	{
+	public:
+		template <typename F>
+		void feed(std::string_view chunk, F&& onRecord)
+		{
+			while (!chunk.empty())
+			{
+				// Complete records are handed out straight from the chunk
+				if (_filled == 0 && chunk.size() >= Size)
+				{
+					onRecord(std::span<const char, Size>(chunk.data(), Size));
+					chunk.remove_prefix(Size);
+					continue;
+				}
+
+				const size_t count = std::min(Size - _filled, chunk.size());
+				std::memcpy(_buffer.data() + _filled, chunk.data(), count);
+				chunk.remove_prefix(count);
+				_filled += count;
+
+				if (_filled == Size)
+				{
+					_filled = 0;
+					onRecord(std::span<const char, Size>(_buffer));
+				}
+			}
+		}
+
+	private:
+		std::array<char, Size> _buffer = {};
+		size_t _filled = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../Core/Futex.hpp"
+
+namespace aita
+{
+	// Hands the latest value from a writer to any number of readers without locks. A seqlock: the sequence is odd
+	// while a value is being written and readers retry until they copy one that did not change under them,
+	// so a reader never holds the writer up. Waiting for a newer value sleeps on the sequence word itself.
+	// Writers must be serialized by the caller.
+	template <typename T>
+	class StateChannel
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "The value is copied word by word");
+
+	public:
+		void publish(const T& value)
+		{
+			std::array<uint64_t, Words> words = {};
+			std::memcpy(words.data(), &value, sizeof(T));
+
+			const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+			_sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			for (size_t i = 0; i < Words; ++i)
+			{
+				_words[i].store(words[i], std::memory_order_relaxed);
+			}
+
+			_sequence.store(sequence + 2);
+
+			// Only a system call when somebody is asleep
+			if (_waiting.load() > 0)
+			{
+				futexWake(_sequence, FutexScope::Private);
+			}
+		}
+
+		// Returns the sequence the value was published under
+		uint32_t read(T& value) const
+		{
+			std::array<uint64_t, Words> words;
+
+			while (true)
+			{
+				const uint32_t sequence = _sequence.load(std::memory_order_acquire);
+
+				if (sequence & 1)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				for (size_t i = 0; i < Words; ++i)
+				{
+					words[i] = _words[i].load(std::memory_order_relaxed);
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+
+				if (_sequence.load(std::memory_order_relaxed) == sequence)
+				{
+					std::memcpy(&value, words.data(), sizeof(T));
+					return sequence;
+				}
+			}
+		}
+
+		uint32_t sequence() const
+		{
+			return _sequence.load(std::memory_order_acquire);
+		}
+
+		// Blocks until a value newer than the sequence is published. Returns false if the deadline passes first.
+		bool wait(uint32_t sequence, std::chrono::steady_clock::time_point deadline) const
+		{
+			while (true)
+			{
+				const uint32_t current = _sequence.load();
+
+				if (current != sequence && !(current & 1))
+				{
+					return true;
+				}
+
+				const auto remaining = deadline - std::chrono::steady_clock::now();
+
+				if (remaining <= std::chrono::nanoseconds(0))
+				{
+					return false;
+				}
+
+				// A publish after the load above changes the word, so the wait cannot miss it
+				_waiting.fetch_add(1);
+				futexWait(_sequence, current, remaining, FutexScope::Private);
+				_waiting.fetch_sub(1);
+			}
+		}
+
+	private:
+		constexpr static size_t Words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+		alignas(64) std::atomic<uint32_t> _sequence = 0;
+		mutable std::atomic<uint32_t> _waiting = 0;
+		std::array<std::atomic<uint64_t>, Words> _words = {};
+	};
+}
\ No newline at end of file
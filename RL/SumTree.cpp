@@ -0,0 +1,60 @@
+#include "SumTree.hpp"
+
+namespace aita
+{
+	SumTree::SumTree(size_t size) :
+		_size(size),
+		_leaves(std::bit_ceil(std::max<size_t>(size, 1))),
+		_nodes(_leaves * 2, 0.0)
+	{
+	}
+
+	size_t SumTree::size() const
+	{
+		return _size;
+	}
+
+	double SumTree::total() const
+	{
+		return _nodes[1];
+	}
+
+	double SumTree::priority(size_t index) const
+	{
+		return _nodes[_leaves + index];
+	}
+
+	void SumTree::update(size_t index, double priority)
+	{
+		size_t node = _leaves + index;
+		_nodes[node] = priority;
+
+		for (node /= 2; node > 0; node /= 2)
+		{
+			_nodes[node] = _nodes[node * 2] + _nodes[node * 2 + 1];
+		}
+	}
+
+	size_t SumTree::find(double value) const
+	{
+		size_t node = 1;
+
+		while (node < _leaves)
+		{
+			const size_t left = node * 2;
+
+			// A value rounded up to the total must not end in the empty leaves on the right
+			if (value < _nodes[left] || _nodes[left + 1] <= 0.0)
+			{
+				node = left;
+			}
+			else
+			{
+				value -= _nodes[left];
+				node = left + 1;
+			}
+		}
+
+		return node - _leaves;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+namespace aita
+{
+	// A binary tree of priority sums in one flat array: the root is at 1, the children of node i at 2i and 2i + 1,
+	// and the leaves at the end. Updating a priority and finding the leaf of a cumulative value both walk
+	// one path, O(log n). The sums are recomputed from the children on the way up, so they do not drift.
+	class SumTree
+	{
+	public:
+		explicit SumTree(size_t size);
+
+		size_t size() const;
+		double total() const;
+		double priority(size_t index) const;
+
+		void update(size_t index, double priority);
+
+		// The leaf whose share of the total contains the value, which must be in [0, total).
+		// Never a leaf without priority while the total is above zero.
+		size_t find(double value) const;
+
+	private:
+		size_t _size;
+		size_t _leaves; // The size rounded up to a power of two
+		std::vector<double> _nodes;
+	};
+}
\ No newline at end of file
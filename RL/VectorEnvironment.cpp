@@ -0,0 +1,165 @@
+#include "VectorEnvironment.hpp"
+#include "Logger.hpp"
+
+namespace aita
+{
+	VectorEnvironment::VectorEnvironment(std::vector<std::unique_ptr<Environment>>&& environments) :
+		_environments(std::move(environments)),
+		_observations(_environments.size()),
+		_results(_environments.size()),
+		_episodeTicks(_environments.size(), 0),
+		_errors(_environments.size())
+	{
+		if (_environments.empty())
+		{
+			throw std::invalid_argument("At least one environment is required");
+		}
+
+		// A single environment is stepped on the calling thread
+		if (_environments.size() == 1)
+		{
+			return;
+		}
+
+		const size_t workers = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, _environments.size());
+
+		for (size_t i = 0; i < workers; ++i)
+		{
+			_workers.emplace_back([this, i](std::stop_token token)
+			{
+				worker(token, i);
+			});
+		}
+
+		LOGI("Stepping {} environments on {} threads", _environments.size(), workers);
+	}
+
+	VectorEnvironment::~VectorEnvironment()
+	{
+		for (std::jthread& worker : _workers)
+		{
+			worker.request_stop();
+		}
+
+		_generation.fetch_add(1);
+		_generation.notify_all();
+		_workers.clear();
+	}
+
+	size_t VectorEnvironment::size() const
+	{
+		return _environments.size();
+	}
+
+	std::span<const GameState> VectorEnvironment::reset()
+	{
+		dispatch(true);
+		return _observations;
+	}
+
+	std::span<const StepResult> VectorEnvironment::step(
+		std::span<const std::bitset<DQNKeys>> actions,
+		std::span<const std::array<float, DQNTimings>> timings)
+	{
+		if (actions.size() != size() || timings.size() != size())
+		{
+			throw std::invalid_argument("One action per environment is required");
+		}
+
+		_actions = actions;
+		_timings = timings;
+		dispatch(false);
+
+		return _results;
+	}
+
+	std::span<const GameState> VectorEnvironment::observations() const
+	{
+		return _observations;
+	}
+
+	int32_t VectorEnvironment::episodeTicks(size_t index) const
+	{
+		return _episodeTicks[index];
+	}
+
+	void VectorEnvironment::dispatch(bool resetting)
+	{
+		_resetting = resetting;
+
+		if (_workers.empty())
+		{
+			work(0);
+		}
+		else
+		{
+			_pending = _workers.size();
+			_generation.fetch_add(1);
+			_generation.notify_all();
+
+			for (size_t pending = _pending; pending != 0; pending = _pending)
+			{
+				_pending.wait(pending);
+			}
+		}
+
+		for (std::exception_ptr& error : _errors)
+		{
+			if (error)
+			{
+				std::rethrow_exception(std::exchange(error, nullptr));
+			}
+		}
+	}
+
+	void VectorEnvironment::work(size_t index)
+	{
+		try
+		{
+			Environment& environment = *_environments[index];
+
+			if (_resetting)
+			{
+				_observations[index] = environment.reset();
+				return;
+			}
+
+			_results[index] = environment.step(_actions[index], _timings[index]);
+			_episodeTicks[index] = environment.ticks();
+
+			_observations[index] = _results[index].done ?
+				environment.reset() :
+				_results[index].state;
+		}
+		catch (...)
+		{
+			_errors[index] = std::current_exception();
+		}
+	}
+
+	void VectorEnvironment::worker(std::stop_token token, size_t first)
+	{
+		uint64_t generation = 0;
+
+		while (true)
+		{
+			_generation.wait(generation);
+			generation = _generation.load();
+
+			if (token.stop_requested())
+			{
+				return;
+			}
+
+			for (size_t i = first; i < _environments.size(); i += _workers.size())
+			{
+				work(i);
+			}
+
+			if (_pending.fetch_sub(1) == 1)
+			{
+				_pending.notify_one();
+			}
+		}
+	}
+}
\ No newline at end of file
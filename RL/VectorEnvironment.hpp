@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Environment.hpp"
+
+namespace aita
+{
+	// Steps several environments concurrently. Environments that finish an episode are reset
+	// automatically, so observations() always holds the state the next action should be decided on.
+	class VectorEnvironment
+	{
+	public:
+		VectorEnvironment(std::vector<std::unique_ptr<Environment>>&& environments);
+		~VectorEnvironment();
+
+		VectorEnvironment(const VectorEnvironment&) = delete;
+		VectorEnvironment& operator = (const VectorEnvironment&) = delete;
+
+		size_t size() const;
+
+		std::span<const GameState> reset();
+		std::span<const StepResult> step(
+			std::span<const std::bitset<DQNKeys>> actions,
+			std::span<const std::array<float, DQNTimings>> timings);
+
+		std::span<const GameState> observations() const;
+		int32_t episodeTicks(size_t index) const;
+
+	private:
+		void dispatch(bool resetting);
+		void work(size_t index);
+		void worker(std::stop_token token, size_t first);
+
+		std::vector<std::unique_ptr<Environment>> _environments;
+		std::vector<GameState> _observations;
+		std::vector<StepResult> _results;
+		std::vector<int32_t> _episodeTicks;
+		std::vector<std::exception_ptr> _errors;
+
+		std::span<const std::bitset<DQNKeys>> _actions;
+		std::span<const std::array<float, DQNTimings>> _timings;
+		bool _resetting = false;
+
+		std::atomic<uint64_t> _generation = 0;
+		std::atomic<size_t> _pending = 0;
+		std::vector<std::jthread> _workers;
+	};
+}
\ No newline at end of file